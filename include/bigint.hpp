@@ -0,0 +1,665 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <ostream>
+#include <algorithm>
+#include <utility>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+
+namespace bigint {
+    using Limb = uint32_t;
+    // Magnitudes are little-endian limbs without leading zero limbs, zero
+    // has no limbs at all
+    using Limbs = std::vector<Limb>;
+
+    namespace details {
+        // Operand sizes in limbs below which the schoolbook algorithms win
+        constexpr size_t KARATSUBA_THRESHOLD = 40;
+        constexpr size_t DIVISION_THRESHOLD = 60;
+        constexpr size_t PRINT_THRESHOLD = 60;
+
+        constexpr size_t LIMB_BITS = 32;
+        constexpr Limb DECIMAL_BASE = 1000000000;
+        constexpr size_t DECIMAL_BASE_DIGITS = 9;
+
+        inline void Trim(Limbs &a) {
+            while (!a.empty() && a.back() == 0)
+                a.pop_back();
+        }
+
+        inline Limbs FromUnsigned(uint64_t value) {
+            Limbs limbs;
+            for (; value != 0; value >>= LIMB_BITS)
+                limbs.push_back(Limb(value));
+            return limbs;
+        }
+
+        inline int Compare(const Limbs &a, const Limbs &b) {
+            if (a.size() != b.size())
+                return a.size() < b.size() ? -1 : 1;
+            for (size_t i = a.size(); i-- != 0;) {
+                if (a[i] != b[i])
+                    return a[i] < b[i] ? -1 : 1;
+            }
+            return 0;
+        }
+
+        // a += b shifted left by the given number of limbs
+        inline void AddTo(Limbs &a, const Limbs &b, size_t shift = 0) {
+            if (a.size() < b.size() + shift)
+                a.resize(b.size() + shift, 0);
+
+            uint64_t carry = 0;
+            size_t i = 0;
+            for (; i < b.size(); ++i) {
+                carry += uint64_t(a[i + shift]) + b[i];
+                a[i + shift] = Limb(carry);
+                carry >>= LIMB_BITS;
+            }
+            for (i += shift; carry != 0 && i < a.size(); ++i) {
+                carry += a[i];
+                a[i] = Limb(carry);
+                carry >>= LIMB_BITS;
+            }
+            if (carry != 0)
+                a.push_back(Limb(carry));
+        }
+
+        // a -= b, a must not be less than b
+        inline void SubFrom(Limbs &a, const Limbs &b) {
+            assert(Compare(a, b) >= 0);
+            uint64_t borrow = 0;
+            for (size_t i = 0; i < a.size() && (i < b.size() || borrow != 0); ++i) {
+                uint64_t sub = (i < b.size() ? b[i] : 0) + borrow;
+                borrow = a[i] < sub;
+                a[i] = Limb(a[i] - sub);
+            }
+            Trim(a);
+        }
+
+        inline Limbs Add(const Limbs &a, const Limbs &b) {
+            Limbs sum = a;
+            AddTo(sum, b);
+            return sum;
+        }
+
+        inline Limbs Sub(const Limbs &a, const Limbs &b) {
+            Limbs difference = a;
+            SubFrom(difference, b);
+            return difference;
+        }
+
+        inline Limbs MulSchoolbook(const Limbs &a, const Limbs &b) {
+            Limbs product(a.size() + b.size(), 0);
+            for (size_t i = 0; i < a.size(); ++i) {
+                if (a[i] == 0)
+                    continue;
+                uint64_t carry = 0;
+                for (size_t j = 0; j < b.size(); ++j) {
+                    carry += uint64_t(a[i]) * b[j] + product[i + j];
+                    product[i + j] = Limb(carry);
+                    carry >>= LIMB_BITS;
+                }
+                product[i + b.size()] = Limb(carry);
+            }
+            Trim(product);
+            return product;
+        }
+
+        inline Limbs Slice(const Limbs &a, size_t begin, size_t end) {
+            begin = std::min(begin, a.size());
+            end = std::min(end, a.size());
+            Limbs slice(a.begin() + begin, a.begin() + end);
+            Trim(slice);
+            return slice;
+        }
+
+        // Karatsuba: three half-size products instead of four. An operand
+        // much longer than the other is cut into pieces of the shorter one.
+        inline Limbs Mul(const Limbs &a, const Limbs &b) {
+            if (a.size() < b.size())
+                return Mul(b, a);
+            if (b.empty())
+                return {};
+            if (b.size() < KARATSUBA_THRESHOLD)
+                return MulSchoolbook(a, b);
+
+            if (a.size() >= 2 * b.size()) {
+                Limbs product;
+                for (size_t i = 0; i < a.size(); i += b.size())
+                    AddTo(product, Mul(Slice(a, i, i + b.size()), b), i);
+                Trim(product);
+                return product;
+            }
+
+            size_t half = a.size() / 2;
+            auto a0 = Slice(a, 0, half), a1 = Slice(a, half, a.size());
+            auto b0 = Slice(b, 0, half), b1 = Slice(b, half, b.size());
+
+            auto low = Mul(a0, b0);
+            auto high = Mul(a1, b1);
+            auto middle = Mul(Add(a0, a1), Add(b0, b1));
+            SubFrom(middle, low);
+            SubFrom(middle, high);
+
+            auto product = std::move(low);
+            AddTo(product, middle, half);
+            AddTo(product, high, 2 * half);
+            Trim(product);
+            return product;
+        }
+
+        inline size_t BitLength(const Limbs &a) {
+            return a.empty() ? 0 : a.size() * LIMB_BITS - size_t(std::countl_zero(a.back()));
+        }
+
+        inline Limbs ShiftLeft(const Limbs &a, size_t bits) {
+            if (a.empty())
+                return {};
+            size_t limbs = bits / LIMB_BITS, rest = bits % LIMB_BITS;
+            Limbs shifted(a.size() + limbs + 1, 0);
+            for (size_t i = 0; i < a.size(); ++i) {
+                uint64_t moved = uint64_t(a[i]) << rest;
+                shifted[i + limbs] |= Limb(moved);
+                shifted[i + limbs + 1] |= Limb(moved >> LIMB_BITS);
+            }
+            Trim(shifted);
+            return shifted;
+        }
+
+        // Bits [first, first + count) of a
+        inline Limbs ExtractBits(const Limbs &a, size_t first, size_t count) {
+            size_t limbs = first / LIMB_BITS, rest = first % LIMB_BITS;
+            if (limbs >= a.size() || count == 0)
+                return {};
+
+            Limbs bits((count + LIMB_BITS - 1) / LIMB_BITS, 0);
+            for (size_t i = 0; i < bits.size() && i + limbs < a.size(); ++i) {
+                uint64_t window = a[i + limbs];
+                if (i + limbs + 1 < a.size())
+                    window |= uint64_t(a[i + limbs + 1]) << LIMB_BITS;
+                bits[i] = Limb(window >> rest);
+            }
+            if (count % LIMB_BITS != 0)
+                bits.back() &= (Limb(1) << (count % LIMB_BITS)) - 1;
+            Trim(bits);
+            return bits;
+        }
+
+        inline Limbs ShiftRight(const Limbs &a, size_t bits) {
+            auto length = BitLength(a);
+            return bits >= length ? Limbs{} : ExtractBits(a, bits, length - bits);
+        }
+
+        // Writes value shifted left by first bits into a, where those bits
+        // of a are zero
+        inline void PlaceBits(Limbs &a, const Limbs &value, size_t first) {
+            auto shifted = ShiftLeft(value, first % LIMB_BITS);
+            size_t limbs = first / LIMB_BITS;
+            if (a.size() < shifted.size() + limbs)
+                a.resize(shifted.size() + limbs, 0);
+            for (size_t i = 0; i < shifted.size(); ++i)
+                a[i + limbs] |= shifted[i];
+        }
+
+        inline Limbs AllOnes(size_t bits) {
+            Limbs ones((bits + LIMB_BITS - 1) / LIMB_BITS, ~Limb(0));
+            if (bits % LIMB_BITS != 0)
+                ones.back() = (Limb(1) << (bits % LIMB_BITS)) - 1;
+            return ones;
+        }
+
+        inline Limb DivModLimb(const Limbs &a, Limb divisor, Limbs &quotient) {
+            quotient.assign(a.size(), 0);
+            uint64_t remainder = 0;
+            for (size_t i = a.size(); i-- != 0;) {
+                uint64_t current = (remainder << LIMB_BITS) | a[i];
+                quotient[i] = Limb(current / divisor);
+                remainder = current % divisor;
+            }
+            Trim(quotient);
+            return Limb(remainder);
+        }
+
+        // Knuth's algorithm D, the divisor has at least two limbs and the
+        // dividend is not less than the divisor
+        inline void DivModKnuth(const Limbs &a, const Limbs &b, Limbs &quotient, Limbs &remainder) {
+            size_t n = b.size(), m = a.size() - n;
+            int shift = std::countl_zero(b.back());
+
+            Limbs v(n), u(a.size() + 1, 0);
+            for (size_t i = n; i-- != 0;)
+                v[i] = Limb((uint64_t(b[i]) << shift) | (i != 0 && shift != 0 ? b[i - 1] >> (LIMB_BITS - shift) : 0));
+            u[a.size()] = shift != 0 ? Limb(a.back() >> (LIMB_BITS - shift)) : 0;
+            for (size_t i = a.size(); i-- != 0;)
+                u[i] = Limb((uint64_t(a[i]) << shift) | (i != 0 && shift != 0 ? a[i - 1] >> (LIMB_BITS - shift) : 0));
+
+            quotient.assign(m + 1, 0);
+            constexpr uint64_t base = uint64_t(1) << LIMB_BITS;
+            for (size_t j = m + 1; j-- != 0;) {
+                uint64_t numerator = (uint64_t(u[j + n]) << LIMB_BITS) | u[j + n - 1];
+                uint64_t qhat = numerator / v[n - 1], rhat = numerator % v[n - 1];
+                while (qhat >= base || qhat * v[n - 2] > ((rhat << LIMB_BITS) | u[j + n - 2])) {
+                    --qhat;
+                    rhat += v[n - 1];
+                    if (rhat >= base)
+                        break;
+                }
+
+                int64_t borrow = 0, t = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    uint64_t product = qhat * v[i];
+                    t = int64_t(u[i + j]) - borrow - int64_t(product & (base - 1));
+                    u[i + j] = Limb(t);
+                    borrow = int64_t(product >> LIMB_BITS) - (t >> LIMB_BITS);
+                }
+                t = int64_t(u[j + n]) - borrow;
+                u[j + n] = Limb(t);
+
+                quotient[j] = Limb(qhat);
+                if (t < 0) {
+                    --quotient[j];
+                    uint64_t carry = 0;
+                    for (size_t i = 0; i < n; ++i) {
+                        carry += uint64_t(u[i + j]) + v[i];
+                        u[i + j] = Limb(carry);
+                        carry >>= LIMB_BITS;
+                    }
+                    u[j + n] = Limb(u[j + n] + carry);
+                }
+            }
+            Trim(quotient);
+
+            remainder.assign(n, 0);
+            for (size_t i = 0; i < n; ++i)
+                remainder[i] = Limb((u[i] >> shift) | (shift != 0 ? uint64_t(u[i + 1]) << (LIMB_BITS - shift) : 0));
+            Trim(remainder);
+        }
+
+        inline void DivModSchoolbook(const Limbs &a, const Limbs &b, Limbs &quotient, Limbs &remainder) {
+            assert(!b.empty());
+            if (Compare(a, b) < 0) {
+                quotient.clear();
+                remainder = a;
+            } else if (b.size() == 1) {
+                remainder = FromUnsigned(DivModLimb(a, b[0], quotient));
+            } else {
+                DivModKnuth(a, b, quotient, remainder);
+            }
+        }
+
+        void DivMod(const Limbs &a, const Limbs &b, Limbs &quotient, Limbs &remainder);
+
+        void DivMod2n1n(const Limbs &a, const Limbs &b, size_t n, Limbs &quotient, Limbs &remainder);
+
+        // Burnikel and Ziegler's recursive division: a 3n-bit by 2n-bit step
+        // made of a 2n-bit by n-bit division and one multiplication, b is
+        // split into b1 and b2 of n bits
+        inline void DivMod3n2n(const Limbs &a12, const Limbs &a3, const Limbs &b, const Limbs &b1, const Limbs &b2,
+                               size_t n, Limbs &quotient, Limbs &remainder) {
+            Limbs partial;
+            if (Compare(ShiftRight(a12, n), b1) == 0) {
+                quotient = AllOnes(n);
+                partial = Sub(a12, ShiftLeft(b1, n));
+                AddTo(partial, b1);
+            } else {
+                DivMod2n1n(a12, b1, n, quotient, partial);
+            }
+
+            auto current = ShiftLeft(partial, n);
+            AddTo(current, a3);
+            Trim(current);
+            auto subtrahend = Mul(quotient, b2);
+            while (Compare(current, subtrahend) < 0) {
+                SubFrom(quotient, { 1 });
+                AddTo(current, b);
+            }
+            SubFrom(current, subtrahend);
+            remainder = std::move(current);
+        }
+
+        // b has exactly n bits and a is less than b shifted left by n bits
+        inline void DivMod2n1n(const Limbs &a, const Limbs &b, size_t n, Limbs &quotient, Limbs &remainder) {
+            if (BitLength(a) <= n + DIVISION_THRESHOLD * LIMB_BITS || n <= DIVISION_THRESHOLD * LIMB_BITS) {
+                DivModSchoolbook(a, b, quotient, remainder);
+                return;
+            }
+
+            if (n % 2 != 0) {
+                DivMod2n1n(ShiftLeft(a, 1), ShiftLeft(b, 1), n + 1, quotient, remainder);
+                remainder = ShiftRight(remainder, 1);
+                return;
+            }
+
+            size_t half = n / 2;
+            auto b1 = ShiftRight(b, half), b2 = ExtractBits(b, 0, half);
+            Limbs high, low, partial;
+            DivMod3n2n(ShiftRight(a, n), ExtractBits(a, half, half), b, b1, b2, half, high, partial);
+            DivMod3n2n(partial, ExtractBits(a, 0, half), b, b1, b2, half, low, remainder);
+
+            quotient = std::move(low);
+            PlaceBits(quotient, high, half);
+            Trim(quotient);
+        }
+
+        // The dividend is cut into digits of the divisor's bit length, each
+        // step divides the remainder and the next digit by the divisor
+        inline void DivMod(const Limbs &a, const Limbs &b, Limbs &quotient, Limbs &remainder) {
+            if (b.size() < DIVISION_THRESHOLD || a.size() < b.size() + DIVISION_THRESHOLD) {
+                DivModSchoolbook(a, b, quotient, remainder);
+                return;
+            }
+
+            size_t n = BitLength(b);
+            size_t digits = (BitLength(a) + n - 1) / n;
+            quotient.clear();
+            remainder.clear();
+            for (size_t i = digits; i-- != 0;) {
+                auto current = ShiftLeft(remainder, n);
+                AddTo(current, ExtractBits(a, i * n, n));
+                Trim(current);
+
+                Limbs digit;
+                DivMod2n1n(current, b, n, digit, remainder);
+                PlaceBits(quotient, digit, i * n);
+            }
+            Trim(quotient);
+        }
+
+        // 10^(9 * 2^k) for every k used so far
+        inline const Limbs &DecimalPower(size_t k) {
+            thread_local std::vector<Limbs> powers = { { DECIMAL_BASE } };
+            while (powers.size() <= k)
+                powers.push_back(Mul(powers.back(), powers.back()));
+            return powers[k];
+        }
+
+        // Appends the digits of a, padded with zeros to width if it is not
+        // zero. Large values are split by a power of ten about half their
+        // size, so printing costs a few divisions of each size instead of
+        // one short division per nine digits.
+        inline void WriteDecimal(const Limbs &a, size_t width, std::string &out) {
+            if (a.size() <= PRINT_THRESHOLD) {
+                std::vector<Limb> chunks;
+                Limbs rest = a, quotient;
+                while (!rest.empty()) {
+                    chunks.push_back(DivModLimb(rest, DECIMAL_BASE, quotient));
+                    std::swap(rest, quotient);
+                }
+
+                std::string digits = chunks.empty() ? std::string() : std::to_string(chunks.back());
+                for (size_t i = chunks.size() - (chunks.empty() ? 0 : 1); i-- != 0;) {
+                    auto chunk = std::to_string(chunks[i]);
+                    digits += std::string(DECIMAL_BASE_DIGITS - chunk.size(), '0') + chunk;
+                }
+                if (digits.size() < width)
+                    out.append(width - digits.size(), '0');
+                out += digits;
+                return;
+            }
+
+            size_t k = 0;
+            while (DecimalPower(k + 1).size() * 2 <= a.size() + 1)
+                ++k;
+            size_t power_digits = DECIMAL_BASE_DIGITS << k;
+
+            Limbs high, low;
+            DivMod(a, DecimalPower(k), high, low);
+            WriteDecimal(high, width > power_digits ? width - power_digits : 0, out);
+            WriteDecimal(low, power_digits, out);
+        }
+
+        inline std::string ToDecimal(const Limbs &a) {
+            if (a.empty())
+                return "0";
+            std::string out;
+            WriteDecimal(a, 0, out);
+            return out;
+        }
+    } // namespace details
+
+    // An integer of any size in one word. Values that fit in 63 bits are
+    // kept in the word itself, shifted left and tagged with a set low bit,
+    // and computed on with the overflow checking builtins; a value that
+    // overflows moves to a reference counted magnitude on the heap. A
+    // magnitude never changes once made, and its count is atomic: tasks of
+    // a parallel run copy the variables and the loop forms they share on
+    // several threads at once.
+    class Integer final {
+    public:
+        Integer(long long value = 0) {
+            if (value >= MIN_SMALL && value <= MAX_SMALL)
+                word_ = Tag(value);
+            else
+                word_ = MakeHeap(value < 0, details::FromUnsigned(value < 0 ? 0ull - uint64_t(value) : uint64_t(value)));
+        }
+
+        Integer(const Integer &other) : word_(other.word_) {
+            if (!IsSmall())
+                GetHeap()->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        Integer(Integer &&other) noexcept : word_(other.word_) {
+            other.word_ = Tag(0);
+        }
+
+        Integer &operator=(const Integer &other) {
+            if (IsSmall() && other.IsSmall()) {
+                word_ = other.word_;
+                return *this;
+            }
+            Integer copy(other);
+            std::swap(word_, copy.word_);
+            return *this;
+        }
+
+        Integer &operator=(Integer &&other) noexcept {
+            std::swap(word_, other.word_);
+            return *this;
+        }
+
+        ~Integer() {
+            if (!IsSmall() && GetHeap()->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                delete GetHeap();
+        }
+
+        explicit operator bool() const {
+            return word_ != Tag(0);
+        }
+
+        friend Integer operator-(const Integer &value) {
+            if (value.IsSmall())
+                return Integer(-value.GetSmall());
+            return FromWord(MakeHeap(!value.GetHeap()->negative, value.GetHeap()->limbs));
+        }
+
+        friend Integer operator+(const Integer &lhs, const Integer &rhs) {
+            intptr_t sum;
+            if (lhs.IsSmall() && rhs.IsSmall() && !__builtin_add_overflow(lhs.word_, rhs.word_ - 1, &sum))
+                return FromWord(sum);
+            return AddSigned(lhs, rhs, false);
+        }
+
+        friend Integer operator-(const Integer &lhs, const Integer &rhs) {
+            intptr_t difference;
+            if (lhs.IsSmall() && rhs.IsSmall() && !__builtin_sub_overflow(lhs.word_, rhs.word_ - 1, &difference))
+                return FromWord(difference);
+            return AddSigned(lhs, rhs, true);
+        }
+
+        friend Integer operator*(const Integer &lhs, const Integer &rhs) {
+            intptr_t product;
+            if (lhs.IsSmall() && rhs.IsSmall() && !__builtin_mul_overflow(lhs.GetSmall(), rhs.word_ - 1, &product))
+                return FromWord(product + 1);
+
+            Limbs lhs_storage, rhs_storage;
+            auto &lhs_limbs = lhs.GetLimbs(lhs_storage), &rhs_limbs = rhs.GetLimbs(rhs_storage);
+            return FromSigned(lhs.IsNegative() != rhs.IsNegative(), details::Mul(lhs_limbs, rhs_limbs));
+        }
+
+        // Both round toward zero like the machine division, the divisor
+        // must not be zero
+        friend Integer operator/(const Integer &lhs, const Integer &rhs) {
+            if (lhs.IsSmall() && rhs.IsSmall())
+                return Integer(lhs.GetSmall() / rhs.GetSmall());
+            Limbs quotient, remainder;
+            DivMod(lhs, rhs, quotient, remainder);
+            return FromSigned(lhs.IsNegative() != rhs.IsNegative(), std::move(quotient));
+        }
+
+        friend Integer operator%(const Integer &lhs, const Integer &rhs) {
+            if (lhs.IsSmall() && rhs.IsSmall())
+                return Integer(lhs.GetSmall() % rhs.GetSmall());
+            Limbs quotient, remainder;
+            DivMod(lhs, rhs, quotient, remainder);
+            return FromSigned(lhs.IsNegative(), std::move(remainder));
+        }
+
+        friend bool operator==(const Integer &lhs, const Integer &rhs) {
+            return CompareSigned(lhs, rhs) == 0;
+        }
+
+        friend bool operator!=(const Integer &lhs, const Integer &rhs) {
+            return CompareSigned(lhs, rhs) != 0;
+        }
+
+        friend bool operator<(const Integer &lhs, const Integer &rhs) {
+            return CompareSigned(lhs, rhs) < 0;
+        }
+
+        friend bool operator>(const Integer &lhs, const Integer &rhs) {
+            return CompareSigned(lhs, rhs) > 0;
+        }
+
+        friend bool operator<=(const Integer &lhs, const Integer &rhs) {
+            return CompareSigned(lhs, rhs) <= 0;
+        }
+
+        friend bool operator>=(const Integer &lhs, const Integer &rhs) {
+            return CompareSigned(lhs, rhs) >= 0;
+        }
+
+        std::string ToString() const {
+            if (IsSmall())
+                return std::to_string(GetSmall());
+            return (GetHeap()->negative ? "-" : "") + details::ToDecimal(GetHeap()->limbs);
+        }
+
+        // The lowest 64 bits in two's complement, what a machine word that
+        // wraps around on overflow would hold
+        uint64_t GetLowBits() const {
+            if (IsSmall())
+                return uint64_t(GetSmall());
+            auto &limbs = GetHeap()->limbs;
+            uint64_t magnitude = limbs[0];
+            if (limbs.size() > 1)
+                magnitude |= uint64_t(limbs[1]) << details::LIMB_BITS;
+            return GetHeap()->negative ? 0 - magnitude : magnitude;
+        }
+
+        friend std::ostream &operator<<(std::ostream &out, const Integer &value) {
+            if (value.IsSmall())
+                return out << value.GetSmall();
+            return out << value.ToString();
+        }
+
+    private:
+        static constexpr long long MAX_SMALL = (1ll << 62) - 1;
+        static constexpr long long MIN_SMALL = -(1ll << 62);
+
+        // Zero is always small, a heap value is never zero
+        struct Heap final {
+            std::atomic<size_t> refs;
+            bool negative;
+            Limbs limbs;
+        }; // struct Heap
+
+        struct FromWordTag final {};
+
+        Integer(intptr_t word, FromWordTag) : word_(word) {}
+
+        static Integer FromWord(intptr_t word) {
+            return Integer(word, FromWordTag{});
+        }
+
+        static intptr_t Tag(long long value) {
+            return intptr_t(uint64_t(value) << 1) | 1;
+        }
+
+        static intptr_t MakeHeap(bool negative, Limbs limbs) {
+            return reinterpret_cast<intptr_t>(new Heap{ 1, negative, std::move(limbs) });
+        }
+
+        static Integer FromSigned(bool negative, Limbs &&limbs) {
+            if (limbs.size() <= 2) {
+                uint64_t magnitude = 0;
+                for (size_t i = limbs.size(); i-- != 0;)
+                    magnitude = (magnitude << details::LIMB_BITS) | limbs[i];
+                if (magnitude <= uint64_t(MAX_SMALL) + negative)
+                    return Integer(negative ? -(long long)magnitude : (long long)magnitude);
+            }
+            return FromWord(MakeHeap(negative, std::move(limbs)));
+        }
+
+        bool IsSmall() const {
+            return word_ & 1;
+        }
+
+        long long GetSmall() const {
+            return word_ >> 1;
+        }
+
+        Heap *GetHeap() const {
+            return reinterpret_cast<Heap*>(word_);
+        }
+
+        bool IsNegative() const {
+            return IsSmall() ? GetSmall() < 0 : GetHeap()->negative;
+        }
+
+        // The magnitude, small values are spelled out in storage
+        const Limbs &GetLimbs(Limbs &storage) const {
+            if (!IsSmall())
+                return GetHeap()->limbs;
+            auto value = GetSmall();
+            storage = details::FromUnsigned(value < 0 ? 0ull - uint64_t(value) : uint64_t(value));
+            return storage;
+        }
+
+        static int CompareSigned(const Integer &lhs, const Integer &rhs) {
+            if (lhs.IsSmall() && rhs.IsSmall())
+                return lhs.word_ < rhs.word_ ? -1 : lhs.word_ > rhs.word_;
+            if (lhs.IsNegative() != rhs.IsNegative())
+                return lhs.IsNegative() ? -1 : 1;
+
+            Limbs lhs_storage, rhs_storage;
+            int magnitude = details::Compare(lhs.GetLimbs(lhs_storage), rhs.GetLimbs(rhs_storage));
+            return lhs.IsNegative() ? -magnitude : magnitude;
+        }
+
+        static Integer AddSigned(const Integer &lhs, const Integer &rhs, bool subtract) {
+            Limbs lhs_storage, rhs_storage;
+            auto &lhs_limbs = lhs.GetLimbs(lhs_storage), &rhs_limbs = rhs.GetLimbs(rhs_storage);
+            bool lhs_negative = lhs.IsNegative(), rhs_negative = rhs.IsNegative() != subtract;
+
+            if (lhs_negative == rhs_negative)
+                return FromSigned(lhs_negative, details::Add(lhs_limbs, rhs_limbs));
+            if (details::Compare(lhs_limbs, rhs_limbs) >= 0)
+                return FromSigned(lhs_negative, details::Sub(lhs_limbs, rhs_limbs));
+            return FromSigned(rhs_negative, details::Sub(rhs_limbs, lhs_limbs));
+        }
+
+        static void DivMod(const Integer &lhs, const Integer &rhs, Limbs &quotient, Limbs &remainder) {
+            Limbs lhs_storage, rhs_storage;
+            auto &rhs_limbs = rhs.GetLimbs(rhs_storage);
+            assert(!rhs_limbs.empty());
+            details::DivMod(lhs.GetLimbs(lhs_storage), rhs_limbs, quotient, remainder);
+        }
+
+        intptr_t word_;
+    }; // class Integer
+} // namespace bigint
@@ -1,7 +1,15 @@
 #pragma once
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <limits>
 #include <cassert>
 
-#include "dotter.hpp"
+#include "interner.hpp"
 #include "node.hpp"
 
 namespace drawer {
@@ -14,10 +22,10 @@ namespace drawer {
 
         { node::UnOpNode_t::minus,                 "-"  },
         { node::UnOpNode_t::negation,              "!"  },
-        
+
         { node::LogicOpNode_t::logic_and,          "&&" },
         { node::LogicOpNode_t::logic_or,           "||" },
-        
+
         { node::BinCompOpNode_t::equal,            "==" },
         { node::BinCompOpNode_t::not_equal,        "!=" },
         { node::BinCompOpNode_t::greater,          ">"  },
@@ -26,172 +34,243 @@ namespace drawer {
         { node::BinCompOpNode_t::less_or_equal,    "<=" }
     };
 
-    class DrawVisitor final : public node::NodeVisitor {
+    enum class Style {
+        Operator,
+        Number,
+        Input,
+        Var,
+        Scope,
+        Decl,
+        Control,
+        Assign,
+        Output
+    };
+
+    const static std::map<Style, std::string> StyleTexts = {
+        { Style::Operator, "shape=box, fillcolor=red, fontcolor=black"        },
+        { Style::Number,   "shape=diamond, fillcolor=blue, fontcolor=white"   },
+        { Style::Input,    "shape=triangle, fillcolor=yellow, fontcolor=black"},
+        { Style::Var,      "shape=diamond, fillcolor=green, fontcolor=black"  },
+        { Style::Scope,    "shape=ellipse, fillcolor=white, fontcolor=black"  },
+        { Style::Decl,     "shape=ellipse, fillcolor=green, fontcolor=black"  },
+        { Style::Control,  "shape=ellipse, fillcolor=blue, fontcolor=white"   },
+        { Style::Assign,   "shape=box, fillcolor=blue, fontcolor=white"       },
+        { Style::Output,   "shape=triangle, fillcolor=yellow, fontcolor=black"}
+    };
+
+    struct DrawOptions final {
+        // nodes at this depth are drawn collapsed, the root has depth zero
+        size_t max_depth = std::numeric_limits<size_t>::max();
+        // ids of nodes drawn collapsed
+        std::unordered_set<size_t> collapsed;
+        // only nodes on these source lines and their ancestors are drawn
+        int first_line = 1;
+        int last_line = std::numeric_limits<int>::max();
+    }; // struct DrawOptions
+
+    // Writes the AST in DOT format while walking it, nothing but the path
+    // from the root to the current node is kept in memory, on the heap. Node ids are
+    // preorder numbers in the whole tree, so a node keeps its id whatever
+    // part of the tree is drawn. A collapsed node stands for its subtree and
+    // is labelled with the number of nodes hidden in it.
+    class DrawVisitor final : public node::WalkVisitor {
     public:
-        DrawVisitor(dotter::Dotter &dotter) : dotter_(dotter) {}
+        DrawVisitor(std::ostream &out, const intern::Interner &interner, const DrawOptions &options) :
+            out_(out), interner_(interner), options_(options) {}
+
+        void Draw(node::Node &root) {
+            out_ << "digraph AST {\n"
+                 << "\tnode [style=\"bold, filled\", color=black];\n";
+            Walk(root);
+            out_ << "}\n";
+        }
 
         void Visit(node::LogicOpNode &node) override {
-            dotter_.SetNodeStyle(dotter::NodeStyle::SHAPES::BOX, dotter::NodeStyle::STYLES::BOLD,
-                                  dotter::COLORS::BLACK, dotter::COLORS::RED, dotter::COLORS::BLACK);
-            
-            dotter_.AddNode(OpTexts.at(node.type_), reinterpret_cast<std::size_t>(std::addressof(node)));
-
-            assert(node.left_);
-            node.left_->Accept(*this);
-            dotter_.AddLink(reinterpret_cast<std::size_t>(std::addressof(node)),
-                            reinterpret_cast<std::size_t>(node.left_));
-
-            assert(node.right_);
-            node.right_->Accept(*this);
-            dotter_.AddLink(reinterpret_cast<std::size_t>(std::addressof(node)),
-                            reinterpret_cast<std::size_t>(node.right_));
-        }
-        
-        void Visit(node::UnOpNode &node) override {
-            dotter_.SetNodeStyle(dotter::NodeStyle::SHAPES::BOX, dotter::NodeStyle::STYLES::BOLD,
-                                  dotter::COLORS::BLACK, dotter::COLORS::RED, dotter::COLORS::BLACK);
-            
-            dotter_.AddNode(OpTexts.at(node.type_), reinterpret_cast<std::size_t>(std::addressof(node)));
+            assert(node.left_ && node.right_);
+            DrawNode(node, OpTexts.at(node.type_), Style::Operator, { node.left_, node.right_ });
+        }
 
+        void Visit(node::UnOpNode &node) override {
             assert(node.child_);
-            node.child_->Accept(*this);
-            dotter_.AddLink(reinterpret_cast<std::size_t>(std::addressof(node)),
-                            reinterpret_cast<std::size_t>(node.child_));
+            DrawNode(node, OpTexts.at(node.type_), Style::Operator, { node.child_ });
         }
 
         void Visit(node::BinOpNode &node) override {
-            dotter_.SetNodeStyle(dotter::NodeStyle::SHAPES::BOX, dotter::NodeStyle::STYLES::BOLD,
-                                  dotter::COLORS::BLACK, dotter::COLORS::RED, dotter::COLORS::BLACK);
-            
-            dotter_.AddNode(OpTexts.at(node.type_), reinterpret_cast<std::size_t>(std::addressof(node)));
-
-            assert(node.left_);
-            node.left_->Accept(*this);
-            dotter_.AddLink(reinterpret_cast<std::size_t>(std::addressof(node)),
-                            reinterpret_cast<std::size_t>(node.left_));
-
-            assert(node.right_);
-            node.right_->Accept(*this);
-            dotter_.AddLink(reinterpret_cast<std::size_t>(std::addressof(node)),
-                            reinterpret_cast<std::size_t>(node.right_));
+            assert(node.left_ && node.right_);
+            DrawNode(node, OpTexts.at(node.type_), Style::Operator, { node.left_, node.right_ });
         }
 
         void Visit(node::BinCompOpNode &node) override {
-            dotter_.SetNodeStyle(dotter::NodeStyle::SHAPES::BOX, dotter::NodeStyle::STYLES::BOLD,
-                                  dotter::COLORS::BLACK, dotter::COLORS::RED, dotter::COLORS::BLACK);
-            
-            dotter_.AddNode(OpTexts.at(node.type_), reinterpret_cast<std::size_t>(std::addressof(node)));
-            assert(node.left_);
-            node.left_->Accept(*this);
-            dotter_.AddLink(reinterpret_cast<std::size_t>(std::addressof(node)),
-                            reinterpret_cast<std::size_t>(node.left_));
-
-            assert(node.right_);
-            node.right_->Accept(*this);
-            dotter_.AddLink(reinterpret_cast<std::size_t>(std::addressof(node)),
-                            reinterpret_cast<std::size_t>(node.right_));
+            assert(node.left_ && node.right_);
+            DrawNode(node, OpTexts.at(node.type_), Style::Operator, { node.left_, node.right_ });
         }
 
         void Visit(node::NumberNode &node) override {
-            dotter_.SetNodeStyle(dotter::NodeStyle::SHAPES::DIAMOND, dotter::NodeStyle::STYLES::BOLD,
-                                  dotter::COLORS::BLACK, dotter::COLORS::BLUE, dotter::COLORS::WHITE);
-            dotter_.AddNode(std::to_string(node.number_), reinterpret_cast<std::size_t>(std::addressof(node)));
+            DrawNode(node, std::to_string(node.number_), Style::Number, {});
         }
 
         void Visit(node::InputNode &node) override {
-            dotter_.SetNodeStyle(dotter::NodeStyle::SHAPES::TRIANGLE, dotter::NodeStyle::STYLES::BOLD,
-                                  dotter::COLORS::BLACK, dotter::COLORS::YELLOW, dotter::COLORS::BLACK);
-            dotter_.AddNode("Input", reinterpret_cast<std::size_t>(std::addressof(node)));
+            DrawNode(node, "Input", Style::Input, {});
         }
 
         void Visit(node::VarNode &node) override {
-            dotter_.SetNodeStyle(dotter::NodeStyle::SHAPES::DIAMOND, dotter::NodeStyle::STYLES::BOLD,
-                                  dotter::COLORS::BLACK, dotter::COLORS::GREEN, dotter::COLORS::BLACK);
-            dotter_.AddNode(node.name_, reinterpret_cast<std::size_t>(std::addressof(node)));
+            DrawNode(node, std::string(interner_.GetName(node.name_)), Style::Var, {});
         }
 
         void Visit(node::ScopeNode &node) override {
-            dotter_.SetNodeStyle(dotter::NodeStyle::SHAPES::ELLIPSE, dotter::NodeStyle::STYLES::BOLD,
-                                  dotter::COLORS::BLACK, dotter::COLORS::WHITE, dotter::COLORS::BLACK);
-            dotter_.AddNode("Scope", reinterpret_cast<std::size_t>(std::addressof(node)));
-            for (size_t i = 0, kids_size = node.kids_.size() ; i < kids_size; ++i) {
-                if (node.kids_[i] == nullptr)
-                    continue;
-                node.kids_[i]->Accept(*this);
-                dotter_.AddLink(reinterpret_cast<std::size_t>(std::addressof(node)), reinterpret_cast<std::size_t>(node.kids_[i]));
-            }
+            DrawNode(node, "Scope", Style::Scope, node.kids_);
         }
 
         void Visit(node::DeclNode &node) override {
-            dotter_.SetNodeStyle(dotter::NodeStyle::SHAPES::ELLIPSE, dotter::NodeStyle::STYLES::BOLD,
-                                  dotter::COLORS::BLACK, dotter::COLORS::GREEN, dotter::COLORS::BLACK);
-            dotter_.AddNode(node.name_, reinterpret_cast<std::size_t>(std::addressof(node)));
+            DrawNode(node, std::string(interner_.GetName(node.name_)), Style::Decl, {});
         }
 
         void Visit(node::CondNode &node) override {
-            dotter_.SetNodeStyle(dotter::NodeStyle::SHAPES::ELLIPSE, dotter::NodeStyle::STYLES::BOLD,
-                                  dotter::COLORS::BLACK, dotter::COLORS::BLUE, dotter::COLORS::WHITE);
-            dotter_.AddNode("If", reinterpret_cast<std::size_t>(std::addressof(node)));
-            assert(node.predicat_);
-            node.predicat_->Accept(*this);
-            dotter_.AddLink(reinterpret_cast<std::size_t>(std::addressof(node)),
-                            reinterpret_cast<std::size_t>(node.predicat_));
-
-            assert(node.first_);
-            node.first_->Accept(*this);
-            dotter_.AddLink(reinterpret_cast<std::size_t>(std::addressof(node)),
-                            reinterpret_cast<std::size_t>(node.first_));
-
-            if (node.second_) {
-                node.second_->Accept(*this);
-                dotter_.AddLink(reinterpret_cast<std::size_t>(std::addressof(node)),
-                                reinterpret_cast<std::size_t>(node.second_));
-            }
+            assert(node.predicat_ && node.first_);
+            DrawNode(node, "If", Style::Control, { node.predicat_, node.first_, node.second_ });
         }
-        
-        void Visit(node::LoopNode &node) override {
-            dotter_.SetNodeStyle(dotter::NodeStyle::SHAPES::ELLIPSE, dotter::NodeStyle::STYLES::BOLD,
-                                  dotter::COLORS::BLACK, dotter::COLORS::BLUE, dotter::COLORS::WHITE);
-            dotter_.AddNode("While", reinterpret_cast<std::size_t>(std::addressof(node)));
 
-            assert(node.predicat_);
-            
-            node.predicat_->Accept(*this);
-            dotter_.AddLink(reinterpret_cast<std::size_t>(std::addressof(node)),
-                            reinterpret_cast<std::size_t>(node.predicat_));
-
-            assert(node.scope_);
-            node.scope_->Accept(*this);
-            dotter_.AddLink(reinterpret_cast<std::size_t>(std::addressof(node)),
-                            reinterpret_cast<std::size_t>(node.scope_));
+        void Visit(node::LoopNode &node) override {
+            assert(node.predicat_ && node.scope_);
+            DrawNode(node, "While", Style::Control, { node.predicat_, node.scope_ });
         }
 
         void Visit(node::AssignNode &node) override {
-            dotter_.SetNodeStyle(dotter::NodeStyle::SHAPES::BOX, dotter::NodeStyle::STYLES::BOLD,
-                                  dotter::COLORS::BLACK, dotter::COLORS::BLUE, dotter::COLORS::WHITE);
-            dotter_.AddNode("=", reinterpret_cast<std::size_t>(std::addressof(node)));
-            assert(node.var_);
-            node.var_->Accept(*this);
-            dotter_.AddLink(reinterpret_cast<std::size_t>(std::addressof(node)),
-                            reinterpret_cast<std::size_t>(node.var_)); 
-
-            assert(node.expr_);
-            node.expr_->Accept(*this);
-            dotter_.AddLink(reinterpret_cast<std::size_t>(std::addressof(node)),
-                            reinterpret_cast<std::size_t>(node.expr_));
+            assert(node.var_ && node.expr_);
+            DrawNode(node, "=", Style::Assign, { node.var_, node.expr_ });
         }
-        
-        void Visit(node::OutputNode &node) override {
-            dotter_.SetNodeStyle(dotter::NodeStyle::SHAPES::TRIANGLE, dotter::NodeStyle::STYLES::BOLD,
-                                  dotter::COLORS::BLACK, dotter::COLORS::YELLOW, dotter::COLORS::BLACK);
-            dotter_.AddNode("Output", reinterpret_cast<std::size_t>(std::addressof(node)));
 
+        void Visit(node::OutputNode &node) override {
             assert(node.expr_);
-            node.expr_->Accept(*this);
-            dotter_.AddLink(reinterpret_cast<std::size_t>(std::addressof(node)),
-                            reinterpret_cast<std::size_t>(node.expr_));
+            DrawNode(node, "Output", Style::Output, { node.expr_ });
         }
+
     private:
-        dotter::Dotter &dotter_;
+        // A node on the current path, written out once a node in focus is
+        // found below it
+        struct Frame final {
+            size_t id;
+            std::string label;
+            Style style;
+            bool written;
+        }; // struct Frame
+
+        // How a node is drawn: as itself, collapsed into one node with its
+        // subtree or not at all, being inside a collapsed subtree
+        enum class Mode {
+            Shown,
+            Collapsed,
+            Hidden
+        };
+
+        void DrawNode(const node::Node &node, std::string label, Style style, std::initializer_list<node::Node*> kids) {
+            DrawNode<std::initializer_list<node::Node*>>(node, std::move(label), style, kids);
+        }
+
+        // Called on every step of the node, the step is the index of the
+        // next kid
+        template <typename Kids>
+        void DrawNode(const node::Node &node, std::string label, Style style, const Kids &kids) {
+            if (GetStep() == 0)
+                Enter(node, std::move(label), style, HasKids(kids));
+            if (!DescendNext(kids))
+                Leave();
+        }
+
+        void Enter(const node::Node &node, std::string label, Style style, bool has_kids) {
+            size_t id = next_id_++;
+            bool in_focus = node.location_.begin.line >= options_.first_line &&
+                            node.location_.begin.line <= options_.last_line;
+
+            if (hidden_depth_ != 0) {
+                ++hidden_count_;
+                hidden_in_focus_ = hidden_in_focus_ || in_focus;
+                modes_.push_back(Mode::Hidden);
+                return;
+            }
+
+            path_.push_back({ id, std::move(label), style, false });
+            bool collapse = has_kids && (path_.size() > options_.max_depth || options_.collapsed.count(id));
+            if (!collapse) {
+                if (in_focus)
+                    WritePath();
+                modes_.push_back(Mode::Shown);
+                return;
+            }
+
+            hidden_count_ = 0;
+            hidden_in_focus_ = in_focus;
+            ++hidden_depth_;
+            modes_.push_back(Mode::Collapsed);
+        }
+
+        void Leave() {
+            auto mode = modes_.back();
+            modes_.pop_back();
+            if (mode == Mode::Hidden)
+                return;
+
+            if (mode == Mode::Collapsed) {
+                --hidden_depth_;
+                if (hidden_in_focus_) {
+                    path_.back().label += " (+" + std::to_string(hidden_count_) + ")";
+                    WritePath();
+                }
+            }
+            path_.pop_back();
+        }
+
+        template <typename Kids>
+        static bool HasKids(const Kids &kids) {
+            for (auto kid : kids) {
+                if (kid != nullptr)
+                    return true;
+            }
+            return false;
+        }
+
+        // Writes the frames of the path that are not written yet, each one
+        // with the edge from its parent
+        void WritePath() {
+            size_t first = path_.size();
+            while (first != 0 && !path_[first - 1].written)
+                --first;
+
+            for (size_t i = first; i < path_.size(); ++i) {
+                auto &frame = path_[i];
+                if (frame.style != current_style_) {
+                    out_ << "\tnode [" << StyleTexts.at(frame.style) << "];\n";
+                    current_style_ = frame.style;
+                }
+
+                out_ << "\tn" << frame.id << " [label=\"";
+                WriteEscaped(frame.label);
+                out_ << "\"];\n";
+                if (i != 0)
+                    out_ << "\tn" << path_[i - 1].id << " -> n" << frame.id << ";\n";
+                frame.written = true;
+            }
+        }
+
+        void WriteEscaped(std::string_view text) {
+            for (auto c : text) {
+                if (c == '"' || c == '\\')
+                    out_ << '\\';
+                out_ << c;
+            }
+        }
+
+        std::ostream &out_;
+        const intern::Interner &interner_;
+        const DrawOptions &options_;
+
+        size_t next_id_ = 0;
+        std::vector<Frame> path_;
+        std::vector<Mode> modes_;
+        std::optional<Style> current_style_;
+
+        size_t hidden_depth_ = 0;
+        size_t hidden_count_ = 0;
+        bool hidden_in_focus_ = false;
     }; // class DrawVisitor
-}; // namespace drawer
\ No newline at end of file
+}; // namespace drawer
@@ -1,30 +1,51 @@
 #pragma once
 #include <vector>
 #include <utility>
+#include <memory>
+#include <string>
+#include <iostream>
+#include <sstream>
+#include <charconv>
+#include <mutex>
 
 #include "error_handler.hpp"
+#include "interner.hpp"
 #include "lexer.hpp"
 #include "executer.hpp"
 #include "drawer.hpp"
+#include "ir.hpp"
+#include "ir_lowering.hpp"
+#include "ir_optimizer.hpp"
+#include "ir_executer.hpp"
+#include "emitter.hpp"
+#include "nesting.hpp"
+#include "induction.hpp"
+#include "parallel.hpp"
+#include "specializer.hpp"
 #include "parser.tab.hh"
 
 namespace yy {
 
+constexpr size_t DEFAULT_MAX_NESTING = 1000000;
+
+// Holds everything produced by compiling one source: the AST, the names
+// and the lines quoted in diagnostics. Drivers are independent of each
+// other, so several programs can be compiled and run at the same time.
 class Driver final {
-    Driver(const std::string_view file_name) : file_name_(file_name), 
-                                         lex_(yy::Lexer::QueryLexer(file_name)),
-                                         err_handler_(err::ErrorHandler::QueryErrorHandler()) {}
-    ~Driver() {}
 public:
-    static Driver &QueryDriver(const std::string_view file_name) {
-        static Driver driver{file_name};
-        return driver;
-    }
+    Driver(std::string source, size_t max_nesting = DEFAULT_MAX_NESTING) :
+        source_(std::move(source)), err_handler_(source_), max_nesting_(max_nesting) {}
+    Driver(const Driver&) = delete;
+    Driver &operator=(const Driver&) = delete;
 
     const char *GetCurrentTokenText() const {
         return lex_.YYText();
     }
 
+    std::string_view GetCurrentTokenView() const {
+        return std::string_view(lex_.YYText(), size_t(lex_.YYLeng()));
+    }
+
     size_t GetCurrentLineNumber() const {
         return size_t(lex_.lineno());
     }
@@ -42,13 +63,11 @@ public:
         parser::token_type tt = static_cast<parser::token_type>(lex_.yylex());
 
         if (tt == yy::parser::token_type::NUMBER) {
-            yylval->as<int>() = std::stoi(GetCurrentTokenText());
+            yylval->emplace<int>(ParseNumber());
         }
 
         if (tt == yy::parser::token_type::NAME) {
-            parser::semantic_type tmp;
-            tmp.as<std::string>() = GetCurrentTokenText();
-            yylval->swap<std::string>(tmp);
+            yylval->emplace<intern::Atom>(interner_.Intern(GetCurrentTokenView()));
         }
 
         if (tt == yy::parser::token_type::ERR) {
@@ -63,8 +82,8 @@ public:
     }
 
     bool Parse() {
-        std::ifstream input_file(file_name_.data());
-        lex_.switch_streams(input_file, std::cout);
+        std::istringstream input(source_);
+        lex_.switch_streams(input, std::cout);
         
         bool res = false; 
         try {
@@ -76,9 +95,24 @@ public:
                                                                         GetLocation()));
         }
 
+        if (res == 0 && root_ != nullptr) {
+            nesting::NestingVisitor(err_handler_, max_nesting_).Check(*root_);
+        }
         return !res;
     }
 
+    const std::string &GetSource() const {
+        return source_;
+    }
+
+    const intern::Interner &GetInterner() const {
+        return interner_;
+    }
+
+    const err::ErrorHandler &GetErrorHandler() const {
+        return err_handler_;
+    }
+
     void SetRootNode(node::Node *root) {
         root_ = root;
     }
@@ -87,24 +121,108 @@ public:
         return root_;
     }
 
-    void Execute() const {
-        executer::ExecuteVisitor executer(err_handler_);
-        root_->Accept(executer);
+    // Only the AST interpreter and the specializer use closed forms, so the
+    // loops are analyzed on first use. Sessions sharing the program may ask
+    // from several threads.
+    const induction::Analysis &GetLoops() const {
+        std::call_once(loops_analyzed_, [this] {
+            if (root_ != nullptr)
+                loops_.Analyze(*root_);
+        });
+        return loops_;
+    }
+
+    // Batches are only run with more than one thread
+    const parallel::Analysis &GetBatches() const {
+        std::call_once(batches_analyzed_, [this] {
+            if (root_ != nullptr)
+                batches_.Analyze(*root_, &GetLoops());
+        });
+        return batches_;
+    }
+
+    // Values are 32-bit words that wrap around on overflow, or integers of
+    // any size with big_integers. Without optimize every loop runs
+    // iteration by iteration. With more than one thread independent
+    // statements that hold loops run at the same time.
+    void Execute(std::istream &in, std::ostream &out, bool big_integers = false, bool optimize = true,
+                 size_t threads = 1) const {
+        if (big_integers)
+            RunExecuter<bigint::Integer>(in, out, optimize, threads);
+        else
+            RunExecuter<int>(in, out, optimize, threads);
     }
 
-    void DrawAST() const {
-        dotter::Dotter dotter;
-        drawer::DrawVisitor drawer(dotter);
-        root_->Accept(drawer);
-        dotter.PrintDotText();
-        dotter.Render();
+    // Runs what the known input decides now, the residual program does the
+    // rest on the whole input. Values are 32-bit words.
+    std::unique_ptr<specializer::Residual> Specialize(const specializer::KnownInput &known) const {
+        specializer::SpecializeVisitor specializer(interner_, known, &GetLoops());
+        return specializer.Specialize(*root_);
+    }
+
+    std::unique_ptr<ir::Function> BuildIR(bool optimize) const {
+        auto function = std::make_unique<ir::Function>();
+        ir::LowerVisitor lower(*function, interner_);
+        lower.Lower(*root_);
+        if (optimize)
+            ir::Optimizer(*function).Run();
+        return function;
+    }
+
+    void ExecuteIR(bool optimize, std::istream &in, std::ostream &out) const {
+        auto function = BuildIR(optimize);
+        ir::Executer executer(*function, err_handler_, in, out);
+        executer.Execute();
+    }
+
+    void DumpIR(std::ostream &out, bool optimize) const {
+        BuildIR(optimize)->Dump(out);
+    }
+
+    void EmitC(std::ostream &out) const {
+        emitter::EmitVisitor emitter(err_handler_, interner_);
+        emitter.Emit(*root_, out);
+    }
+
+    void DrawAST(std::ostream &out, const drawer::DrawOptions &options) const {
+        drawer::DrawVisitor drawer(out, interner_, options);
+        drawer.Draw(*root_);
     }
 
 private:
-    yy::Lexer &lex_;
+    template <typename Value>
+    void RunExecuter(std::istream &in, std::ostream &out, bool optimize, size_t threads) const {
+        executer::StreamInput input(in);
+        parallel::Pool pool(threads);
+        bool concurrent = threads > 1;
+        executer::BasicExecuteVisitor<Value> executer(err_handler_, interner_, input, out, optimize ? &GetLoops() : nullptr,
+                                                      concurrent ? &GetBatches() : nullptr, concurrent ? &pool : nullptr);
+        executer.Execute(*root_);
+    }
+
+    // The literal is all digits, so the only possible failure is overflow
+    int ParseNumber() const {
+        auto text = GetCurrentTokenView();
+        int number = 0;
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+        if (error == std::errc::result_out_of_range) {
+            throw std::logic_error(err_handler_.GetFullErrorMessage("Lexical error, integer literal is out of range", \
+                                    std::string("'" + std::string(text) + "'"), \
+                                    GetLocation()));
+        }
+        return number;
+    }
+
+    const std::string source_;
+    err::ErrorHandler err_handler_;
+    size_t max_nesting_;
+    yy::Lexer lex_;
     node::Node *root_ = nullptr;
     node::details::Builder<node::Node> builder_;
-    const std::string_view file_name_;
-    err::ErrorHandler &err_handler_;
+    intern::Interner interner_;
+    mutable std::once_flag loops_analyzed_;
+    mutable induction::Analysis loops_;
+    mutable std::once_flag batches_analyzed_;
+    mutable parallel::Analysis batches_;
 };
 } // namespace yy
\ No newline at end of file
@@ -0,0 +1,641 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <sstream>
+#include <ostream>
+#include <unordered_set>
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+
+#include "error_handler.hpp"
+#include "node.hpp"
+#include "name_resolver.hpp"
+
+namespace emitter {
+    constexpr size_t MAX_INDENT_DEPTH = 32;
+
+    // Runtime support shared by every generated program. Arithmetic wraps
+    // like the interpreter, output is buffered and input follows the rules
+    // of std::cin: once a read fails every following read yields zero.
+    // Functions a program may never call are inline, which compilers do not
+    // warn about.
+    const static std::string Prelude = R"(#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+
+static char pcl_out[1 << 16];
+static size_t pcl_out_size;
+static int pcl_interactive;
+static int pcl_in_failed;
+
+static void pcl_flush(void) {
+    fwrite(pcl_out, 1, pcl_out_size, stdout);
+    fflush(stdout);
+    pcl_out_size = 0;
+}
+
+static _Noreturn void pcl_error(const char *message) {
+    pcl_flush();
+    puts(message);
+    exit(0);
+}
+
+static inline void pcl_print(int value) {
+    char digits[10];
+    int count = 0;
+    unsigned rest = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+    do
+        digits[count++] = (char)('0' + rest % 10);
+    while (rest /= 10);
+
+    if (pcl_out_size + sizeof digits + 2 > sizeof pcl_out)
+        pcl_flush();
+    if (value < 0)
+        pcl_out[pcl_out_size++] = '-';
+    while (count)
+        pcl_out[pcl_out_size++] = digits[--count];
+    pcl_out[pcl_out_size++] = '\n';
+}
+
+static inline int pcl_input(void) {
+    if (pcl_interactive)
+        pcl_flush();
+    if (pcl_in_failed)
+        return 0;
+
+    int c = getchar();
+    while (c == ' ' || (c >= '\t' && c <= '\r'))
+        c = getchar();
+
+    int negative = c == '-';
+    if (c == '-' || c == '+')
+        c = getchar();
+    if (c < '0' || c > '9') {
+        pcl_in_failed = 1;
+        return 0;
+    }
+
+    long long value = 0;
+    for (; c >= '0' && c <= '9'; c = getchar()) {
+        if (value <= INT_MAX)
+            value = value * 10 + (c - '0');
+    }
+    if (c != EOF)
+        ungetc(c, stdin);
+
+    value = negative ? -value : value;
+    if (value > INT_MAX || value < INT_MIN) {
+        pcl_in_failed = 1;
+        return value > INT_MAX ? INT_MAX : INT_MIN;
+    }
+    return (int)value;
+}
+
+static inline int pcl_neg(int value) { return (int)(0u - (unsigned)value); }
+static inline int pcl_add(int lhs, int rhs) { return (int)((unsigned)lhs + (unsigned)rhs); }
+static inline int pcl_sub(int lhs, int rhs) { return (int)((unsigned)lhs - (unsigned)rhs); }
+static inline int pcl_mul(int lhs, int rhs) { return (int)((unsigned)lhs * (unsigned)rhs); }
+
+static inline int pcl_div(int lhs, int rhs, const char *message) {
+    if (rhs == 0)
+        pcl_error(message);
+    return rhs == -1 ? pcl_neg(lhs) : lhs / rhs;
+}
+
+static inline int pcl_rem(int lhs, int rhs, const char *message) {
+    if (rhs == 0)
+        pcl_error(message);
+    return rhs == -1 ? 0 : lhs % rhs;
+}
+)";
+
+    namespace details {
+        // Collects names assigned directly in a scope, nested scopes excluded
+        class LocalNamesVisitor final : public node::WalkVisitor {
+        public:
+            std::vector<intern::Atom> Collect(node::ScopeNode &scope) {
+                for (auto &statement : scope.kids_) {
+                    if (statement != nullptr)
+                        Walk(*statement);
+                }
+                return std::move(names_);
+            }
+
+            void Visit(node::LogicOpNode &node) override {
+                DescendNext({ node.left_, node.right_ });
+            }
+
+            void Visit(node::UnOpNode &node) override {
+                DescendNext({ node.child_ });
+            }
+
+            void Visit(node::BinOpNode &node) override {
+                DescendNext({ node.left_, node.right_ });
+            }
+
+            void Visit(node::BinCompOpNode &node) override {
+                DescendNext({ node.left_, node.right_ });
+            }
+
+            void Visit(node::NumberNode &node) override {}
+            void Visit(node::InputNode &node) override {}
+            void Visit(node::VarNode &node) override {}
+            void Visit(node::ScopeNode &node) override {}
+            void Visit(node::DeclNode &node) override {}
+
+            void Visit(node::CondNode &node) override {
+                DescendNext({ node.predicat_, node.first_, node.second_ });
+            }
+
+            void Visit(node::LoopNode &node) override {
+                DescendNext({ node.predicat_, node.scope_ });
+            }
+
+            void Visit(node::AssignNode &node) override {
+                if (DescendNext({ node.expr_ }))
+                    return;
+                if (seen_.insert(node.var_->name_).second)
+                    names_.push_back(node.var_->name_);
+            }
+
+            void Visit(node::OutputNode &node) override {
+                DescendNext({ node.expr_ });
+            }
+
+        private:
+            std::vector<intern::Atom> names_;
+            std::unordered_set<intern::Atom> seen_;
+        }; // class LocalNamesVisitor
+    } // namespace details
+
+    // Translates the AST into a single C translation unit. Every expression
+    // is evaluated into its own temporary, which keeps the left to right
+    // order of side effects; the C compiler folds them back. Variables are
+    // locals of the C block generated for their ScopeNode, names that may be
+    // unassigned at run time carry a flag next to the value. A first walk
+    // finds the values and flags that are ever read, the others are neither
+    // declared nor stored.
+    class EmitVisitor final : public node::WalkVisitor {
+    public:
+        EmitVisitor(const err::ErrorHandler &err_handler, const intern::Interner &interner) :
+            err_handler_(err_handler), interner_(interner) {}
+
+        void Emit(node::Node &root, std::ostream &out) {
+            EmitVisitor reads(err_handler_, interner_);
+            reads.Walk(root);
+            read_ = std::move(reads.read_);
+            pruned_ = true;
+
+            depth_ = 1;
+            Walk(root);
+
+            out << Prelude << "\n";
+            for (size_t i = 0; i < messages_.size(); ++i)
+                out << "static const char pcl_msg" << i << "[] = " << Quote(messages_[i]) << ";\n";
+            out << "\nint main(void) {\n"
+                << "    pcl_interactive = isatty(0);\n"
+                << body_.str()
+                << "    pcl_flush();\n"
+                << "    return 0;\n"
+                << "}\n";
+        }
+
+        void Visit(node::LogicOpNode &node) override {
+            switch (GetStep()) {
+                case 0:
+                    assert(node.left_);
+                    Descend(*node.left_, 1);
+                    return;
+                case 1: {
+                    auto &pending = PushPending();
+                    pending.value = NewTemp();
+                    bool is_or = node.type_ == node::LogicOpNode_t::logic_or;
+                    Line() << "int " << pending.value << " = " << is_or << ";\n";
+                    Line() << "if (" << (is_or ? "!" : "") << value_ << ") {\n";
+
+                    ++depth_;
+                    pending.mark = resolver_.Mark();
+                    assert(node.right_);
+                    Descend(*node.right_, 2);
+                    return;
+                }
+                default: {
+                    auto pending = PopPending();
+                    resolver_.Undo(pending.mark);
+                    Line() << pending.value << " = " << value_ << " != 0;\n";
+                    --depth_;
+
+                    Line() << "}\n";
+                    value_ = pending.value;
+                    return;
+                }
+            }
+        }
+
+        void Visit(node::UnOpNode &node) override {
+            assert(node.child_);
+            if (DescendNext({ node.child_ }))
+                return;
+
+            switch (node.type_) {
+                case node::UnOpNode_t::minus:
+                    Define("pcl_neg(" + value_ + ")");
+                    return;
+                case node::UnOpNode_t::negation:
+                    Define("!" + value_);
+                    return;
+            }
+        }
+
+        void Visit(node::BinOpNode &node) override {
+            std::string left;
+            if (!EmitOperands(node, left))
+                return;
+            auto right = value_;
+
+            switch (node.type_) {
+                case node::BinOpNode_t::add:
+                    Define("pcl_add(" + left + ", " + right + ")");
+                    return;
+                case node::BinOpNode_t::sub:
+                    Define("pcl_sub(" + left + ", " + right + ")");
+                    return;
+                case node::BinOpNode_t::mul:
+                    Define("pcl_mul(" + left + ", " + right + ")");
+                    return;
+                case node::BinOpNode_t::div:
+                    Define("pcl_div(" + left + ", " + right + ", " + Message("Division by zero", node.location_) + ")");
+                    return;
+                case node::BinOpNode_t::remainder:
+                    Define("pcl_rem(" + left + ", " + right + ", " + Message("Division by zero", node.location_) + ")");
+                    return;
+            }
+        }
+
+        void Visit(node::BinCompOpNode &node) override {
+            std::string left;
+            if (!EmitOperands(node, left))
+                return;
+            auto right = value_;
+
+            switch (node.type_) {
+                case node::BinCompOpNode_t::equal:
+                    Define(left + " == " + right);
+                    return;
+                case node::BinCompOpNode_t::not_equal:
+                    Define(left + " != " + right);
+                    return;
+                case node::BinCompOpNode_t::greater:
+                    Define(left + " > " + right);
+                    return;
+                case node::BinCompOpNode_t::less:
+                    Define(left + " < " + right);
+                    return;
+                case node::BinCompOpNode_t::greater_or_equal:
+                    Define(left + " >= " + right);
+                    return;
+                case node::BinCompOpNode_t::less_or_equal:
+                    Define(left + " <= " + right);
+                    return;
+            }
+        }
+
+        void Visit(node::NumberNode &node) override {
+            value_ = std::to_string(node.number_);
+        }
+
+        void Visit(node::InputNode &node) override {
+            Define("pcl_input()");
+        }
+
+        void Visit(node::VarNode &node) override {
+            auto slots = resolver_.GetCandidateSlots(node.name_);
+            if (!slots.empty() && resolver_.IsDefinite(slots.front())) {
+                Define(ReadValue(slots.front(), node.name_));
+                return;
+            }
+
+            auto result = NewTemp();
+            Line() << "int " << result << ";\n";
+            for (auto slot : slots) {
+                if (resolver_.IsDefinite(slot)) {
+                    Line() << "else\n";
+                    Line() << "    " << result << " = " << ReadValue(slot, node.name_) << ";\n";
+                    value_ = result;
+                    return;
+                }
+                Line() << (slot == slots.front() ? "if (" : "else if (") << ReadFlag(slot, node.name_) << ")\n";
+                Line() << "    " << result << " = " << ReadValue(slot, node.name_) << ";\n";
+            }
+
+            auto message = Message("'" + std::string(interner_.GetName(node.name_)) + "' was not declared in this scope", node.location_);
+            if (slots.empty()) {
+                Line() << "pcl_error(" << message << ");\n";
+            } else {
+                Line() << "else\n";
+                Line() << "    pcl_error(" << message << ");\n";
+            }
+            value_ = result;
+        }
+
+        // A scope used as the body of if or while shares braces with it
+        void Visit(node::ScopeNode &node) override {
+            if (GetStep() == 0) {
+                auto &pending = PushPending();
+                pending.braces = !shared_braces_;
+                shared_braces_ = false;
+                if (pending.braces) {
+                    Line() << "{\n";
+                    ++depth_;
+                }
+
+                resolver_.PushScope();
+                auto scope_id = resolver_.GetCurrentScopeId();
+                for (auto name : details::LocalNamesVisitor().Collect(node)) {
+                    auto suffix = std::to_string(scope_id) + "_" + std::string(interner_.GetName(name));
+                    if (IsRead("v" + suffix))
+                        Line() << "int v" << suffix << " = 0;\n";
+                    if (IsRead("d" + suffix))
+                        Line() << "unsigned char d" << suffix << " = 0;\n";
+                }
+            }
+
+            if (DescendNext(node.kids_))
+                return;
+            resolver_.PopScope();
+            if (PopPending().braces) {
+                --depth_;
+                Line() << "}\n";
+            }
+        }
+
+        void Visit(node::DeclNode &node) override {}
+
+        void Visit(node::CondNode &node) override {
+            switch (GetStep()) {
+                case 0:
+                    assert(node.predicat_);
+                    Descend(*node.predicat_, 1);
+                    return;
+                case 1:
+                    PushPending().mark = resolver_.Mark();
+                    assert(node.first_);
+                    OpenBlock("if (" + value_ + ")", *node.first_, 2);
+                    return;
+                case 2: {
+                    CloseBlock();
+                    auto &pending = pending_.back();
+                    pending.assigned = resolver_.Undo(pending.mark);
+                    if (node.second_) {
+                        OpenBlock("else", *node.second_, 3);
+                        return;
+                    }
+                    break;
+                }
+                default: {
+                    CloseBlock();
+                    auto &pending = pending_.back();
+                    resolver_.Join(pending.assigned, resolver_.Undo(pending.mark));
+                    break;
+                }
+            }
+            PopPending();
+        }
+
+        void Visit(node::LoopNode &node) override {
+            switch (GetStep()) {
+                case 0:
+                    Line() << "for (;;) {\n";
+                    ++depth_;
+                    assert(node.predicat_);
+                    Descend(*node.predicat_, 1);
+                    return;
+                case 1:
+                    Line() << "if (!" << value_ << ")\n";
+                    Line() << "    break;\n";
+
+                    PushPending().mark = resolver_.Mark();
+                    assert(node.scope_);
+                    OpenBlock("", *node.scope_, 2);
+                    return;
+                default:
+                    CloseBlock();
+                    resolver_.Undo(PopPending().mark);
+
+                    --depth_;
+                    Line() << "}\n";
+                    return;
+            }
+        }
+
+        void Visit(node::AssignNode &node) override {
+            assert(node.expr_);
+            if (DescendNext({ node.expr_ }))
+                return;
+            assert(node.var_);
+            auto name = node.var_->name_;
+            auto value = value_;
+
+            auto slots = resolver_.GetCandidateSlots(name);
+            if (resolver_.IsStaticStore(name, slots)) {
+                auto slot = slots.empty() ? resolver_.GetLocalSlot(name) : slots.front();
+                if (!Store(slot, name, value))
+                    Discard(value);
+                resolver_.SetDefinite(slot);
+                return;
+            }
+
+            bool stored = false;
+            for (auto slot : slots) {
+                if (resolver_.IsDefinite(slot)) {
+                    Line() << "else {\n";
+                    ++depth_;
+                    stored = Store(slot, name, value) || stored;
+                    --depth_;
+                    Line() << "}\n";
+                    if (!stored)
+                        Discard(value);
+                    return;
+                }
+                // the flag keeps the value from going to a later slot even
+                // if it is never read
+                auto target = GetValueName(slot, name);
+                Line() << (slot == slots.front() ? "if (" : "else if (") << ReadFlag(slot, name) << ")"
+                       << (IsRead(target) ? "\n" : " {}\n");
+                if (IsRead(target)) {
+                    Line() << "    " << target << " = " << value << ";\n";
+                    stored = true;
+                }
+            }
+
+            Line() << "else {\n";
+            ++depth_;
+            stored = Store(resolver_.GetLocalSlot(name), name, value) || stored;
+            --depth_;
+            Line() << "}\n";
+            if (!stored)
+                Discard(value);
+        }
+
+        void Visit(node::OutputNode &node) override {
+            assert(node.expr_);
+            if (DescendNext({ node.expr_ }))
+                return;
+            Line() << "pcl_print(" << value_ << ");\n";
+        }
+
+    private:
+        // What a node keeps between its steps
+        struct Pending final {
+            std::string value;
+            size_t mark = 0;
+            std::vector<size_t> assigned;
+            bool braces = false;
+        }; // struct Pending
+
+        Pending &PushPending() {
+            return pending_.emplace_back();
+        }
+
+        Pending PopPending() {
+            auto pending = std::move(pending_.back());
+            pending_.pop_back();
+            return pending;
+        }
+
+        // Emits the left and then the right operand, the left value waits
+        // on the pending stack. True once both are emitted.
+        template <typename Node>
+        bool EmitOperands(Node &node, std::string &left) {
+            switch (GetStep()) {
+                case 0:
+                    assert(node.left_);
+                    Descend(*node.left_, 1);
+                    return false;
+                case 1:
+                    PushPending().value = value_;
+                    assert(node.right_);
+                    Descend(*node.right_, 2);
+                    return false;
+                default:
+                    left = PopPending().value;
+                    return true;
+            }
+        }
+
+        // Opens the braces of an if or while body and descends into it
+        void OpenBlock(const std::string &header, node::Node &statement, size_t next_step) {
+            Line() << header << (header.empty() ? "{\n" : " {\n");
+            ++depth_;
+            shared_braces_ = dynamic_cast<node::ScopeNode*>(&statement) != nullptr;
+            Descend(statement, next_step);
+        }
+
+        void CloseBlock() {
+            --depth_;
+            Line() << "}\n";
+        }
+
+        // True if the value is stored, a value nothing reads is not
+        bool Store(size_t slot, intern::Atom name, const std::string &value) {
+            auto target = GetValueName(slot, name);
+            bool stored = IsRead(target);
+            if (stored)
+                Line() << target << " = " << value << ";\n";
+            auto flag = GetFlagName(slot, name);
+            if (IsRead(flag))
+                Line() << flag << " = 1;\n";
+            return stored;
+        }
+
+        // The temporary of a value that is never stored is still evaluated
+        // for its side effects, a literal has none
+        void Discard(const std::string &value) {
+            if (!std::isdigit(static_cast<unsigned char>(value.front())))
+                Line() << "(void)" << value << ";\n";
+        }
+
+        void Define(const std::string &expr) {
+            auto temp = NewTemp();
+            Line() << "int " << temp << " = " << expr << ";\n";
+            value_ = temp;
+        }
+
+        std::string NewTemp() {
+            return "t" + std::to_string(temp_count_++);
+        }
+
+        std::string GetValueName(size_t slot, intern::Atom name) const {
+            return "v" + std::to_string(resolver_.GetSlotScopeId(slot)) + "_" + std::string(interner_.GetName(name));
+        }
+
+        std::string GetFlagName(size_t slot, intern::Atom name) const {
+            return "d" + std::to_string(resolver_.GetSlotScopeId(slot)) + "_" + std::string(interner_.GetName(name));
+        }
+
+        std::string ReadValue(size_t slot, intern::Atom name) {
+            auto value = GetValueName(slot, name);
+            if (!pruned_)
+                read_.insert(value);
+            return value;
+        }
+
+        std::string ReadFlag(size_t slot, intern::Atom name) {
+            auto flag = GetFlagName(slot, name);
+            if (!pruned_)
+                read_.insert(flag);
+            return flag;
+        }
+
+        // Until the reads are known every value and flag is kept
+        bool IsRead(const std::string &variable) const {
+            return !pruned_ || read_.count(variable) != 0;
+        }
+
+        // Runtime errors are rendered at compile time with the source line
+        std::string Message(const std::string &text, const yy::Location &location) {
+            messages_.push_back(err_handler_.GetFullErrorMessage("Runtime error", text, location));
+            return "pcl_msg" + std::to_string(messages_.size() - 1);
+        }
+
+        static std::string Quote(const std::string &text) {
+            std::string quoted = "\"";
+            for (unsigned char c : text) {
+                if (c == '"' || c == '\\') {
+                    quoted += '\\';
+                    quoted += char(c);
+                } else if (c == '\n') {
+                    quoted += "\\n";
+                } else if (c < ' ' || c >= 0x7f) {
+                    const char octal[] = { '\\', char('0' + (c >> 6)), char('0' + ((c >> 3) & 7)), char('0' + (c & 7)), 0 };
+                    quoted += octal;
+                } else {
+                    quoted += char(c);
+                }
+            }
+            return quoted + "\"";
+        }
+
+        // Indentation stops growing at some depth, so deeply nested programs
+        // do not produce a quadratic amount of whitespace
+        std::ostream &Line() {
+            body_ << std::string(4 * std::min(depth_, MAX_INDENT_DEPTH), ' ');
+            return body_;
+        }
+
+        const err::ErrorHandler &err_handler_;
+        const intern::Interner &interner_;
+        resolver::NameResolver resolver_;
+        std::ostringstream body_;
+        std::vector<std::string> messages_;
+        std::string value_;
+        std::vector<Pending> pending_;
+        std::unordered_set<std::string> read_;
+        bool pruned_ = false;
+        bool shared_braces_ = false;
+        size_t temp_count_ = 0;
+        size_t depth_ = 0;
+    }; // class EmitVisitor
+} // namespace emitter
@@ -1,28 +1,41 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <string_view>
 #include "location.hpp"
 
 namespace err {
 
+// Keeps the lines of the compiled source to quote them in diagnostics
 class ErrorHandler final {
-    ErrorHandler() = default;
-    ~ErrorHandler() = default;
 public:
-    static ErrorHandler &QueryErrorHandler() {
-        static ErrorHandler error_handler{};
-        return error_handler;
+    ErrorHandler(std::string_view source) {
+        while (!source.empty()) {
+            auto end = source.find('\n');
+            code_lines_.emplace_back(source.substr(0, end));
+            if (end == std::string_view::npos)
+                break;
+            source.remove_prefix(end + 1);
+        }
     }
 
     std::string GetFullErrorMessage(std::string_view error_name, \
                                     std::string_view error_mes, \
                                     const yy::Location &loc) const { 
         auto mes = std::string(error_name) + ": " + std::string(error_mes) + ", at line #" + std::to_string(loc.begin.line) + ":\n"; 
-        mes += (loc.GetCodeLine(loc.begin.line - 1) + "\n");
+        mes += (GetCodeLine(loc.begin.line - 1) + "\n");
         mes += std::string(loc.begin.column - 1, ' ');
         mes += std::string(loc.end.column - loc.begin.column, '^');
 
         return mes;
     }
+
+private:
+    // A token at the end of the input may point past the last line
+    std::string GetCodeLine(size_t line_num) const {
+        return line_num < code_lines_.size() ? code_lines_[line_num] : std::string{};
+    }
+
+    std::vector<std::string> code_lines_;
 };
 } // namespace err
\ No newline at end of file
@@ -1,263 +1,568 @@
 #pragma once
-#include <unordered_map>
+#include <vector>
 #include <optional>
 #include <exception>
 #include <limits>
 #include <cassert>
 #include <algorithm>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 #include "error_handler.hpp"
+#include "interner.hpp"
 #include "node.hpp"
+#include "bigint.hpp"
+#include "induction.hpp"
+#include "parallel.hpp"
 
 namespace executer {
     constexpr size_t DEFAULT_NAME_COUNT = 32; 
+    // Nodes a task of a batch runs before it checks whether an earlier
+    // statement has failed
+    constexpr size_t TASK_SLICE = 4096;
     namespace symTable {
-        class SymbolTable final {
-        public:
-            void SetOrAddValue(std::string_view name, int value) {
-                varMap_[std::string(name)] = value;
-            }
-
-            std::optional<int> GetValue(std::string_view name) const {
-                auto name_str = std::string(name);
-                
-                auto hit = varMap_.find(name_str);
-                if (hit != varMap_.end()) 
-                    return varMap_.at(name_str);
-
-                return std::nullopt;
-            }
-
-        private:
-            std::unordered_map<std::string, int> varMap_;
-        };
-
+        // Every name has a stack of bindings, one per scope that declared
+        // it, so lookups cost the same at any nesting depth. A scope
+        // remembers the names it declared to drop their bindings on exit.
+        template <typename Value>
         class SymbolTables final {
         public:
             SymbolTables() {
-                symbolTables_.reserve(DEFAULT_NAME_COUNT);
+                declared_.reserve(DEFAULT_NAME_COUNT);
             }
 
-            void SetValue(std::string_view name, int value) {
-                auto rbegin = symbolTables_.rbegin();
-                auto rend = symbolTables_.rend();
-                auto pred = [&name] (const SymbolTable& cur) {
-                    auto find = cur.GetValue(name);
-                    return find.has_value();
-                };
-                
-                auto it = std::find_if(rbegin, rend, pred);
-                if (it != rend) {
-                    it->SetOrAddValue(name, value);
-                }
+            // Stores into the innermost binding or declares the name in the
+            // current scope
+            void SetValue(intern::Atom name, const Value &value) {
+                if (name >= bindings_.size())
+                    bindings_.resize(name + 1);
 
-                symbolTables_.back().SetOrAddValue(name, value);
-            } 
+                auto &bindings = bindings_[name];
+                if (!bindings.empty()) {
+                    bindings.back() = value;
+                    return;
+                }
 
-            int GetValue(std::string_view name) const {
-                auto rbegin = symbolTables_.rbegin();
-                auto rend = symbolTables_.rend();
-                auto pred = [&name] (const SymbolTable& cur) {
-                    auto find = cur.GetValue(name);
-                    return find.has_value();
-                };
+                bindings.push_back(value);
+                declared_.push_back(name);
+            }
 
-                auto it = std::find_if(rbegin, rend, pred);
-                if (it != rend) {
-                    return *(it->GetValue(name));
-                }
+            const Value *GetValue(intern::Atom name) const {
+                if (name < bindings_.size() && !bindings_[name].empty())
+                    return &bindings_[name].back();
 
-                throw std::runtime_error(name.data());
+                return nullptr;
             }
 
             void PushSymTable() {
-                symbolTables_.emplace_back();
+                scopes_.push_back(declared_.size());
             }
 
             void PopSymTable() {
-                symbolTables_.pop_back();
+                assert(!scopes_.empty());
+                for (auto i = scopes_.back(); i < declared_.size(); ++i)
+                    bindings_[declared_[i]].pop_back();
+                declared_.resize(scopes_.back());
+                scopes_.pop_back();
             }
         private:
-            std::vector<SymbolTable> symbolTables_;
+            std::vector<std::vector<Value>> bindings_;
+            std::vector<intern::Atom> declared_;
+            std::vector<size_t> scopes_;
         };
     }; // namespace symTable
 
-    class ExecuteVisitor final : public node::NodeVisitor {
+    // Where a program reads its numbers from, with the rules of std::cin:
+    // once a read fails every following read yields zero. Read() returns
+    // nothing while the next number has not arrived yet.
+    class Input {
+    public:
+        virtual ~Input() = default;
+        virtual std::optional<int> Read() = 0;
+    }; // class Input
+
+    // Blocks until the stream has the number
+    class StreamInput final : public Input {
     public:
-        ExecuteVisitor(err::ErrorHandler &err_handler) : err_handler_(err_handler) {}
+        StreamInput(std::istream &in) : in_(in) {}
+
+        std::optional<int> Read() override {
+            int value = 0;
+            in_ >> value;
+            return value;
+        }
+
+    private:
+        std::istream &in_;
+    }; // class StreamInput
+
+    // How the interpreter computes on its values. Machine words wrap around
+    // like the IR and the native code do, the one quotient that does not fit
+    // included. FromExact() gives the value computed where the exact result
+    // is the given integer.
+    template <typename Value>
+    struct Arithmetic final {
+        static bigint::Integer ToExact(const Value &value) { return value; }
+        static Value FromExact(const bigint::Integer &value) { return value; }
+        static Value Neg(const Value &value) { return -value; }
+        static Value Add(const Value &lhs, const Value &rhs) { return lhs + rhs; }
+        static Value Sub(const Value &lhs, const Value &rhs) { return lhs - rhs; }
+        static Value Mul(const Value &lhs, const Value &rhs) { return lhs * rhs; }
+        static Value Div(const Value &lhs, const Value &rhs) { return lhs / rhs; }
+        static Value Rem(const Value &lhs, const Value &rhs) { return lhs % rhs; }
+    }; // struct Arithmetic
+
+    template <>
+    struct Arithmetic<int> final {
+        static bigint::Integer ToExact(int value) { return value; }
+        static int FromExact(const bigint::Integer &value) { return int(uint32_t(value.GetLowBits())); }
+        static int Neg(int value) { return int(0u - unsigned(value)); }
+        static int Add(int lhs, int rhs) { return int(unsigned(lhs) + unsigned(rhs)); }
+        static int Sub(int lhs, int rhs) { return int(unsigned(lhs) - unsigned(rhs)); }
+        static int Mul(int lhs, int rhs) { return int(unsigned(lhs) * unsigned(rhs)); }
+        static int Div(int lhs, int rhs) { return rhs == -1 ? Neg(lhs) : lhs / rhs; }
+        static int Rem(int lhs, int rhs) { return rhs == -1 ? 0 : lhs % rhs; }
+    }; // struct Arithmetic<int>
+
+    // Runs the program on the AST. Values of subexpressions are kept on a
+    // stack: every expression pushes its value and its parent pops it. An
+    // assignment used as a statement leaves its value behind, statements
+    // never appear inside expressions, so the stack is cleared after each.
+    // A run may also go in slices: Start() and then Resume() until it is
+    // done, the run suspends itself when the input is not ready. Values are
+    // 32-bit words or, with bigint::Integer, integers of any size. Loops the
+    // analysis found a closed form for are not run, their variables get the
+    // final values at once.
+    //
+    // Given batches and a pool, the tasks of a batch run on the pool, each
+    // on its own executer with copies of the variables it touches. The
+    // output of every statement is kept apart and written in program order
+    // as soon as the statements before it are done, and the first error in
+    // program order is the one thrown, so the run prints what a run in
+    // order would. Once the tasks are done the variables they assigned are
+    // stored back. A run in slices never gets batches.
+    template <typename Value>
+    class BasicExecuteVisitor final : public node::WalkVisitor {
+    public:
+        BasicExecuteVisitor(const err::ErrorHandler &err_handler, const intern::Interner &interner,
+                       Input &in, std::ostream &out, const induction::Analysis *loops = nullptr,
+                       const parallel::Analysis *batches = nullptr, parallel::Pool *pool = nullptr) :
+            err_handler_(err_handler), interner_(interner), in_(in), out_(out), loops_(loops),
+            batches_(pool != nullptr ? batches : nullptr), pool_(pool) {}
+
+        void Execute(node::Node &root) {
+            Walk(root);
+        }
+
+        void Start(node::Node &root) {
+            values_.clear();
+            WalkVisitor::Start(root);
+        }
+
+        // Runs at most max_steps nodes, returns true once the program is done
+        bool Resume(size_t max_steps) {
+            return WalkVisitor::Resume(max_steps);
+        }
+
+        bool IsWaitingForInput() const {
+            return IsSuspended();
+        }
 
         void Visit(node::LogicOpNode &node) override {
-            assert(node.left_);
-            node.left_->Accept(*this);
-            int operand1 = GetParam();
-            assert(node.right_);
-            node.right_->Accept(*this);
-            int operand2 = GetParam();
+            switch (GetStep()) {
+                case 0:
+                    assert(node.left_);
+                    if (!Evaluate(*node.left_, 1))
+                        return;
+                    [[fallthrough]];
+                case 1: {
+                    auto operand1 = PopValue();
+
+                    // the right operand is evaluated only if it decides the result
+                    switch (node.type_) {
+                        case node::LogicOpNode_t::logic_and:
+                            if (!operand1) {
+                                PushValue(0);
+                                return;
+                            }
+                            break;
+                        case node::LogicOpNode_t::logic_or:
+                            if (operand1) {
+                                PushValue(1);
+                                return;
+                            }
+                            break;
+                    }
 
-            switch (node.type_) {
-                case node::LogicOpNode_t::logic_and:
-                    SetParam(operand1 && operand2);
-                    return;
-                case node::LogicOpNode_t::logic_or:
-                    SetParam(operand1 || operand2);
+                    assert(node.right_);
+                    if (!Evaluate(*node.right_, 2))
+                        return;
+                    [[fallthrough]];
+                }
+                default:
+                    PushValue(bool(PopValue()));
                     return;
             }
         }
 
         void Visit(node::UnOpNode &node) override {
             assert(node.child_);
-            node.child_->Accept(*this);
+            if (GetStep() == 0 && !Evaluate(*node.child_, 1))
+                return;
 
             switch (node.type_) {
                 case node::UnOpNode_t::minus:
-                    SetParam(-GetParam());
+                    PushValue(Arithmetic<Value>::Neg(PopValue()));
                     return;
                 case node::UnOpNode_t::negation:
-                    SetParam(!GetParam());
+                    PushValue(!PopValue());
                     return;
             }
         }
 
         void Visit(node::BinOpNode &node) override {
-            assert(node.left_);
-            node.left_->Accept(*this);
-            int operand1 = GetParam();
-            assert(node.right_);
-            node.right_->Accept(*this);
-            int operand2 = GetParam();
+            if (!EvaluateOperands(node))
+                return;
+            // the result takes the place of the left operand
+            auto &operand1 = values_[values_.size() - 2];
+            const auto &operand2 = values_.back();
 
             switch (node.type_) {
                 case node::BinOpNode_t::add:
-                    SetParam(operand1 + operand2);
-                    return;
+                    operand1 = Arithmetic<Value>::Add(operand1, operand2);
+                    break;
                 case node::BinOpNode_t::sub:
-                    SetParam(operand1 - operand2);
-                    return;
+                    operand1 = Arithmetic<Value>::Sub(operand1, operand2);
+                    break;
                 case node::BinOpNode_t::mul:
-                    SetParam(operand1 * operand2);
-                    return;
+                    operand1 = Arithmetic<Value>::Mul(operand1, operand2);
+                    break;
                 case node::BinOpNode_t::div:
-                    if (operand2 == 0) {
+                case node::BinOpNode_t::remainder:
+                    if (!operand2) {
                         throw std::runtime_error(err_handler_.GetFullErrorMessage("Runtime error", \
                                                                                 "Division by zero", \
                                                                                 node.location_));
                     }
-                    SetParam(operand1 / operand2);
-                    return;
-                case node::BinOpNode_t::remainder:
-                    SetParam(operand1 % operand2);
-                    return;  
+                    operand1 = node.type_ == node::BinOpNode_t::div ? Arithmetic<Value>::Div(operand1, operand2) :
+                                                                      Arithmetic<Value>::Rem(operand1, operand2);
+                    break;
             }
+            values_.pop_back();
         }
 
         void Visit(node::BinCompOpNode &node) override {
-            assert(node.left_);
-            node.left_->Accept(*this);
-            int operand1 = GetParam();
-            assert(node.right_);
-            node.right_->Accept(*this);
-            int operand2 = GetParam();
+            if (!EvaluateOperands(node))
+                return;
+            auto &operand1 = values_[values_.size() - 2];
+            const auto &operand2 = values_.back();
 
             switch (node.type_) {
                 case node::BinCompOpNode_t::equal:
-                    SetParam(operand1 == operand2);
-                    return;
+                    operand1 = operand1 == operand2;
+                    break;
                 case node::BinCompOpNode_t::not_equal:
-                    SetParam(operand1 != operand2);
-                    return;
+                    operand1 = operand1 != operand2;
+                    break;
                 case node::BinCompOpNode_t::greater:
-                    SetParam(operand1 > operand2);
-                    return;
+                    operand1 = operand1 > operand2;
+                    break;
                 case node::BinCompOpNode_t::less:
-                    SetParam(operand1 < operand2);
-                    return;
+                    operand1 = operand1 < operand2;
+                    break;
                 case node::BinCompOpNode_t::greater_or_equal:
-                    SetParam(operand1 >= operand2);
-                    return;
+                    operand1 = operand1 >= operand2;
+                    break;
                 case node::BinCompOpNode_t::less_or_equal:
-                    SetParam(operand1 <= operand2);
-                    return;
+                    operand1 = operand1 <= operand2;
+                    break;
             }
+            values_.pop_back();
         }
 
         void Visit(node::NumberNode &node) override {
-            SetParam(node.number_);
+            PushValue(node.number_);
         }
 
         void Visit(node::InputNode &node) override {
-            int input = 0;
-            std::cin >> input;
-            SetParam(input);
+            auto input = in_.Read();
+            if (!input) {
+                Suspend();
+                return;
+            }
+            PushValue(*input);
         }
 
         void Visit(node::VarNode &node) override {
-            try {
-                SetParam(symbolTables_.GetValue(node.name_));
-            } catch(std::runtime_error& ex) {
+            auto value = symbolTables_.GetValue(node.name_);
+            if (!value) {
                 throw std::runtime_error(err_handler_.GetFullErrorMessage("Runtime error", \
-                            std::string("'" + std::string(ex.what()) + "' was not declared in this scope"), \
+                            std::string("'" + std::string(interner_.GetName(node.name_)) + "' was not declared in this scope"), \
                             node.location_));
             }
+            PushValue(*value);
         }
 
         void Visit(node::ScopeNode &node) override {
-            symbolTables_.PushSymTable();
-            for (auto &statement : node.kids_) {
-                if (statement != nullptr)
-                    statement->Accept(*this);
+            if (GetStep() == 0)
+                symbolTables_.PushSymTable();
+            values_.clear();
+
+            if (batches_ != nullptr) {
+                for (auto step = GetStep(); step < node.kids_.size(); step = GetStep()) {
+                    auto batch = batches_->Find(*node.kids_[step]);
+                    if (batch == nullptr)
+                        break;
+                    RunBatch(node, *batch);
+                    SetStep(step + batch->count);
+                }
             }
-            symbolTables_.PopSymTable();
+            if (!DescendNext(node.kids_))
+                symbolTables_.PopSymTable();
         }
 
         void Visit(node::DeclNode &node) override {}
 
         void Visit(node::CondNode &node) override {
-            node.predicat_->Accept(*this);
-
-            if (GetParam()) {
-                assert(node.first_);
-                node.first_->Accept(*this);
-            } else {
-                if (node.second_)
-                    node.second_->Accept(*this);
+            switch (GetStep()) {
+                case 0:
+                    assert(node.predicat_);
+                    if (!Evaluate(*node.predicat_, 1))
+                        return;
+                    [[fallthrough]];
+                case 1:
+                    if (PopValue()) {
+                        assert(node.first_);
+                        Descend(*node.first_, 2);
+                    } else if (node.second_) {
+                        Descend(*node.second_, 2);
+                    }
+                    return;
+                default:
+                    values_.clear();
+                    return;
             }
         }
 
+        // Steps alternate between the predicate and the body
         void Visit(node::LoopNode &node) override {
+            auto step = GetStep();
+            if (step == 0 && SkipLoop(node))
+                return;
+            if (step == 2)
+                values_.clear();
             assert(node.predicat_);
-            node.predicat_->Accept(*this);
-            assert(node.scope_);
+            if (step != 1 && !Evaluate(*node.predicat_, 1))
+                return;
 
-            while (GetParam()) {
-                node.scope_->Accept(*this);
-                node.predicat_->Accept(*this);
+            if (PopValue()) {
+                assert(node.scope_);
+                Descend(*node.scope_, 2);
             }
         }
 
         void Visit(node::AssignNode &node) override {
             assert(node.expr_);
-            node.expr_->Accept(*this);
+            if (GetStep() == 0 && !Evaluate(*node.expr_, 1))
+                return;
+
             assert(node.var_);
-            symbolTables_.SetValue(node.var_->name_, GetParam());
+            // the assignment is an expression, its value stays on the stack
+            symbolTables_.SetValue(node.var_->name_, values_.back());
         }
 
         void Visit(node::OutputNode &node) override {
             assert(node.expr_);
-            node.expr_->Accept(*this);
-            std::cout << GetParam() << std::endl;
+            if (GetStep() == 0 && !Evaluate(*node.expr_, 1))
+                return;
+            out_ << PopValue() << std::endl;
         }
 
     private:
-        int GetParam() const {
-            return param_;
+        // Leaves are evaluated in place, other expressions get a frame of
+        // their own. Returns whether the value is already pushed.
+        bool Evaluate(node::ExprNode &expr, size_t next_step) {
+            if (expr.IsLeaf()) {
+                expr.Accept(*this);
+                return true;
+            }
+
+            Descend(expr, next_step);
+            return false;
+        }
+
+        template <typename Node>
+        bool EvaluateOperands(Node &node) {
+            switch (GetStep()) {
+                case 0:
+                    assert(node.left_);
+                    if (!Evaluate(*node.left_, 1))
+                        return false;
+                    [[fallthrough]];
+                case 1:
+                    assert(node.right_);
+                    return Evaluate(*node.right_, 2);
+                default:
+                    return true;
+            }
+        }
+
+        // Assigns the final values of a loop with a closed form, false if the
+        // loop has to run
+        bool SkipLoop(const node::LoopNode &node) {
+            auto loop = loops_ != nullptr ? loops_->Find(node) : nullptr;
+            if (loop == nullptr)
+                return false;
+
+            auto lookup = [this](intern::Atom name) -> std::optional<bigint::Integer> {
+                auto value = symbolTables_.GetValue(name);
+                if (!value)
+                    return std::nullopt;
+                return Arithmetic<Value>::ToExact(*value);
+            };
+            auto narrow = [](const bigint::Integer &value) {
+                return Arithmetic<Value>::ToExact(Arithmetic<Value>::FromExact(value));
+            };
+            auto results = induction::Solve(*loop, lookup, narrow);
+            if (!results)
+                return false;
+            for (auto &[name, value] : *results)
+                symbolTables_.SetValue(name, Arithmetic<Value>::FromExact(value));
+            return true;
+        }
+
+        // What one statement of a batch did
+        struct Outcome final {
+            std::string output;
+            std::exception_ptr error;
+            bool done = false;
+        }; // struct Outcome
+
+        // Shared by the tasks of a batch and the thread that waits for them
+        struct BatchRun final {
+            size_t first = 0;
+            std::vector<Outcome> outcomes;
+            // values of the variables every task assigned
+            std::vector<std::vector<std::pair<intern::Atom, Value>>> results;
+            // the first statement that failed, later ones need not run
+            std::atomic<size_t> failed;
+            size_t running = 0;
+            std::mutex mutex;
+            std::condition_variable changed;
+        }; // struct BatchRun
+
+        void RunBatch(node::ScopeNode &node, const parallel::Batch &batch) {
+            auto step = GetStep();
+            BatchRun run;
+            run.first = step;
+            run.outcomes.resize(batch.count);
+            run.results.resize(batch.tasks.size());
+            run.failed = step + batch.count;
+            run.running = batch.tasks.size();
+
+            for (size_t i = 0; i < batch.tasks.size(); ++i) {
+                std::vector<std::pair<intern::Atom, Value>> seeds;
+                for (auto name : batch.tasks[i].names) {
+                    if (auto value = symbolTables_.GetValue(name))
+                        seeds.emplace_back(name, *value);
+                }
+                pool_->Submit([this, &node, &task = batch.tasks[i], &run, i, seeds = std::move(seeds)] {
+                    RunTask(node, task, seeds, run, run.results[i]);
+                    std::lock_guard<std::mutex> lock(run.mutex);
+                    --run.running;
+                    run.changed.notify_all();
+                });
+            }
+
+            std::exception_ptr error;
+            std::unique_lock<std::mutex> lock(run.mutex);
+            for (auto &outcome : run.outcomes) {
+                run.changed.wait(lock, [&outcome] { return outcome.done; });
+                if (!outcome.output.empty())
+                    out_ << outcome.output << std::flush;
+                if (outcome.error) {
+                    error = outcome.error;
+                    break;
+                }
+            }
+            run.changed.wait(lock, [&run] { return run.running == 0; });
+            if (error)
+                std::rethrow_exception(error);
+
+            for (auto &results : run.results) {
+                for (auto &[name, value] : results)
+                    symbolTables_.SetValue(name, value);
+            }
+        }
+
+        // Runs on a thread of the pool, touches nothing of this executer
+        // but what does not change during the batch
+        void RunTask(node::ScopeNode &node, const parallel::Batch::Task &task,
+                     const std::vector<std::pair<intern::Atom, Value>> &seeds, BatchRun &run,
+                     std::vector<std::pair<intern::Atom, Value>> &results) const {
+            std::ostringstream out;
+            BasicExecuteVisitor executer(err_handler_, interner_, in_, out, loops_);
+            for (auto &[name, value] : seeds)
+                executer.symbolTables_.SetValue(name, value);
+
+            for (auto index : task.statements) {
+                if (run.failed < index)
+                    return;
+                std::exception_ptr error;
+                try {
+                    executer.Start(*node.kids_[index]);
+                    while (!executer.Resume(TASK_SLICE)) {
+                        if (run.failed < index)
+                            return;
+                    }
+                } catch (...) {
+                    error = std::current_exception();
+                    for (auto failed = run.failed.load(); index < failed && !run.failed.compare_exchange_weak(failed, index);) {}
+                }
+
+                std::lock_guard<std::mutex> lock(run.mutex);
+                auto &outcome = run.outcomes[index - run.first];
+                outcome.output = out.str();
+                outcome.error = error;
+                outcome.done = true;
+                out.str({});
+                run.changed.notify_all();
+                if (error)
+                    return;
+            }
+
+            for (auto name : task.assigned) {
+                if (auto value = executer.symbolTables_.GetValue(name))
+                    results.emplace_back(name, *value);
+            }
+        }
+
+        Value PopValue() {
+            assert(!values_.empty());
+            auto value = std::move(values_.back());
+            values_.pop_back();
+            return value;
         }
 
-        void SetParam(int param) {
-            param_ = param;
+        void PushValue(Value value) {
+            values_.push_back(std::move(value));
         }
 
-        int param_ = 0;
-        symTable::SymbolTables symbolTables_;
-        err::ErrorHandler &err_handler_;
-    }; // class ExecuteVisitor
-}
\ No newline at end of file
+        std::vector<Value> values_;
+        symTable::SymbolTables<Value> symbolTables_;
+        const err::ErrorHandler &err_handler_;
+        const intern::Interner &interner_;
+        Input &in_;
+        std::ostream &out_;
+        const induction::Analysis *loops_;
+        const parallel::Analysis *batches_;
+        parallel::Pool *pool_;
+    }; // class BasicExecuteVisitor
+
+    using ExecuteVisitor = BasicExecuteVisitor<int>;
+}
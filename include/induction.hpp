@@ -0,0 +1,458 @@
+#pragma once
+#include <vector>
+#include <optional>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+#include <cassert>
+
+#include "interner.hpp"
+#include "node.hpp"
+#include "bigint.hpp"
+
+namespace induction {
+    // constant + coefficient * variable + ..., computed exactly. Terms with
+    // a zero coefficient are dropped.
+    class LinearForm final {
+    public:
+        struct Term final {
+            intern::Atom name;
+            bigint::Integer coefficient;
+        }; // struct Term
+
+        LinearForm(bigint::Integer constant = 0) : constant_(std::move(constant)) {}
+
+        static LinearForm Variable(intern::Atom name) {
+            LinearForm form;
+            form.terms_.push_back({ name, 1 });
+            return form;
+        }
+
+        bool IsConstant() const {
+            return terms_.empty();
+        }
+
+        const bigint::Integer &GetConstant() const {
+            return constant_;
+        }
+
+        const std::vector<Term> &GetTerms() const {
+            return terms_;
+        }
+
+        // Adds factor * other
+        void Add(const LinearForm &other, const bigint::Integer &factor = 1) {
+            constant_ = constant_ + other.constant_ * factor;
+            for (auto &term : other.terms_) {
+                auto it = std::find_if(terms_.begin(), terms_.end(), [&term](auto &mine) { return mine.name == term.name; });
+                if (it == terms_.end()) {
+                    terms_.push_back({ term.name, term.coefficient * factor });
+                    continue;
+                }
+                it->coefficient = it->coefficient + term.coefficient * factor;
+                if (!it->coefficient)
+                    terms_.erase(it);
+            }
+        }
+
+        void Scale(const bigint::Integer &factor) {
+            if (!factor)
+                terms_.clear();
+            constant_ = constant_ * factor;
+            for (auto &term : terms_)
+                term.coefficient = term.coefficient * factor;
+        }
+
+        // value(name) gives the value of a variable of the form
+        template <typename Values>
+        bigint::Integer Evaluate(Values value) const {
+            auto result = constant_;
+            for (auto &term : terms_)
+                result = result + term.coefficient * value(term.name);
+            return result;
+        }
+
+    private:
+        bigint::Integer constant_;
+        std::vector<Term> terms_;
+    }; // class LinearForm
+
+    // A loop whose body only adds to variables that live outside of it:
+    //
+    //     while (i < n) {
+    //         s = s + 2 * i + c;
+    //         i = i + 1;
+    //     }
+    //
+    // Every statement of the body is an assignment x = x + step. A counter
+    // steps by the same amount on every iteration: its step reads no variable
+    // the body assigns. Any other step is linear in counters and variables
+    // the body does not assign, so it changes by the same amount from one
+    // iteration to the next. The predicate compares a counter with a bound
+    // the body does not change.
+    struct Loop final {
+        struct Update final {
+            intern::Atom name;
+            LinearForm step;
+            bool counter;
+        }; // struct Update
+
+        intern::Atom counter;
+        // counter relation bound
+        node::BinCompOpNode_t relation;
+        LinearForm bound;
+        // in the order of the body
+        std::vector<Update> updates;
+        // every variable the loop reads
+        std::vector<intern::Atom> reads;
+    }; // struct Loop
+
+    namespace details {
+        // Builds the linear form of an expression. Fails on anything but
+        // numbers, variables, sums, differences, negations and products by a
+        // constant: the rest either has side effects or does not commute with
+        // the wrap around of machine words.
+        class LinearVisitor final : public node::WalkVisitor {
+        public:
+            std::optional<LinearForm> Build(node::ExprNode &expr) {
+                failed_ = false;
+                forms_.clear();
+                Walk(expr);
+                if (failed_)
+                    return std::nullopt;
+                assert(forms_.size() == 1);
+                return std::move(forms_.back());
+            }
+
+            void Visit(node::LogicOpNode &node) override {
+                failed_ = true;
+            }
+
+            void Visit(node::UnOpNode &node) override {
+                if (failed_ || node.type_ != node::UnOpNode_t::minus) {
+                    failed_ = true;
+                    return;
+                }
+                if (DescendNext({ node.child_ }))
+                    return;
+                forms_.back().Scale(-1);
+            }
+
+            void Visit(node::BinOpNode &node) override {
+                if (failed_ || node.type_ == node::BinOpNode_t::div || node.type_ == node::BinOpNode_t::remainder) {
+                    failed_ = true;
+                    return;
+                }
+                if (DescendNext({ node.left_, node.right_ }))
+                    return;
+
+                auto rhs = std::move(forms_.back());
+                forms_.pop_back();
+                auto &lhs = forms_.back();
+                switch (node.type_) {
+                    case node::BinOpNode_t::add:
+                        lhs.Add(rhs);
+                        return;
+                    case node::BinOpNode_t::sub:
+                        lhs.Add(rhs, -1);
+                        return;
+                    case node::BinOpNode_t::mul:
+                        if (rhs.IsConstant()) {
+                            lhs.Scale(rhs.GetConstant());
+                        } else if (lhs.IsConstant()) {
+                            rhs.Scale(lhs.GetConstant());
+                            lhs = std::move(rhs);
+                        } else {
+                            failed_ = true;
+                        }
+                        return;
+                    default:
+                        return;
+                }
+            }
+
+            void Visit(node::BinCompOpNode &node) override {
+                failed_ = true;
+            }
+
+            void Visit(node::NumberNode &node) override {
+                forms_.emplace_back(node.number_);
+            }
+
+            void Visit(node::InputNode &node) override {
+                failed_ = true;
+            }
+
+            void Visit(node::VarNode &node) override {
+                forms_.push_back(LinearForm::Variable(node.name_));
+            }
+
+            void Visit(node::ScopeNode &node) override {
+                failed_ = true;
+            }
+
+            void Visit(node::DeclNode &node) override {
+                failed_ = true;
+            }
+
+            void Visit(node::CondNode &node) override {
+                failed_ = true;
+            }
+
+            void Visit(node::LoopNode &node) override {
+                failed_ = true;
+            }
+
+            void Visit(node::AssignNode &node) override {
+                failed_ = true;
+            }
+
+            void Visit(node::OutputNode &node) override {
+                failed_ = true;
+            }
+
+        private:
+            std::vector<LinearForm> forms_;
+            bool failed_ = false;
+        }; // class LinearVisitor
+
+        inline node::BinCompOpNode_t Mirror(node::BinCompOpNode_t relation) {
+            switch (relation) {
+                case node::BinCompOpNode_t::greater:
+                    return node::BinCompOpNode_t::less;
+                case node::BinCompOpNode_t::less:
+                    return node::BinCompOpNode_t::greater;
+                case node::BinCompOpNode_t::greater_or_equal:
+                    return node::BinCompOpNode_t::less_or_equal;
+                case node::BinCompOpNode_t::less_or_equal:
+                    return node::BinCompOpNode_t::greater_or_equal;
+                default:
+                    return relation;
+            }
+        }
+
+        // Number of values of start, start + step, ... the relation with the
+        // bound holds for before it first fails, nothing if it never fails
+        inline std::optional<bigint::Integer> TripCount(const bigint::Integer &start, const bigint::Integer &step,
+                                                        node::BinCompOpNode_t relation, const bigint::Integer &bound) {
+            assert(step);
+            switch (relation) {
+                case node::BinCompOpNode_t::greater:
+                    return TripCount(-start, -step, node::BinCompOpNode_t::less, -bound);
+                case node::BinCompOpNode_t::greater_or_equal:
+                    return TripCount(-start, -step, node::BinCompOpNode_t::less, -bound + 1);
+                case node::BinCompOpNode_t::less_or_equal:
+                    return TripCount(start, step, node::BinCompOpNode_t::less, bound + 1);
+                case node::BinCompOpNode_t::less:
+                    if (start >= bound)
+                        return bigint::Integer(0);
+                    if (step < 0)
+                        return std::nullopt;
+                    return (bound - start + step - 1) / step;
+                case node::BinCompOpNode_t::equal:
+                    return bigint::Integer(start == bound);
+                case node::BinCompOpNode_t::not_equal: {
+                    auto distance = bound - start;
+                    if (distance % step || (distance < 0) != (step < 0))
+                        return std::nullopt;
+                    return distance / step;
+                }
+            }
+            return std::nullopt;
+        }
+    } // namespace details
+
+    // Final values of the variables a loop assigns, given the values of the
+    // variables it reads, or nothing if the loop has to run: a variable is
+    // not declared, the counter does not move or overflows, the loop never
+    // ends. narrow(x) is the value the program computes where the exact
+    // result is x; sums and products commute with it, comparisons do not,
+    // so the counter must not wrap around.
+    template <typename Lookup, typename Narrow>
+    std::optional<std::vector<std::pair<intern::Atom, bigint::Integer>>> Solve(const Loop &loop, Lookup lookup, Narrow narrow) {
+        std::unordered_map<intern::Atom, bigint::Integer> values;
+        for (auto name : loop.reads) {
+            auto value = lookup(name);
+            if (!value)
+                return std::nullopt;
+            values.emplace(name, std::move(*value));
+        }
+        auto value = [&values](intern::Atom name) { return values.at(name); };
+
+        std::unordered_map<intern::Atom, bigint::Integer> steps;
+        for (auto &update : loop.updates) {
+            if (update.counter)
+                steps.emplace(update.name, narrow(update.step.Evaluate(value)));
+        }
+
+        auto &start = values.at(loop.counter);
+        auto &step = steps.at(loop.counter);
+        if (!step)
+            return std::nullopt;
+        auto count = details::TripCount(start, step, loop.relation, narrow(loop.bound.Evaluate(value)));
+        if (!count)
+            return std::nullopt;
+        auto end = start + *count * step;
+        if (narrow(end) != end)
+            return std::nullopt;
+
+        // a step is first + iteration * delta
+        auto triangle = *count * (*count - 1) / 2;
+        std::vector<std::pair<intern::Atom, bigint::Integer>> results;
+        for (size_t i = 0; i < loop.updates.size(); ++i) {
+            auto &update = loop.updates[i];
+            bigint::Integer first = update.step.GetConstant(), delta = 0;
+            for (auto &term : update.step.GetTerms()) {
+                first = first + term.coefficient * values.at(term.name);
+                auto counter = steps.find(term.name);
+                if (counter == steps.end())
+                    continue;
+                delta = delta + term.coefficient * counter->second;
+                // the counter has already stepped in this iteration
+                for (size_t j = 0; j < i; ++j) {
+                    if (loop.updates[j].name == term.name)
+                        first = first + term.coefficient * counter->second;
+                }
+            }
+            results.emplace_back(update.name, values.at(update.name) + *count * first + triangle * delta);
+        }
+        return results;
+    }
+
+    // Finds the loops of a program that have a closed form
+    class Analysis final {
+    public:
+        void Analyze(node::Node &root) {
+            loops_.clear();
+            FindVisitor(*this).Find(root);
+        }
+
+        const Loop *Find(const node::LoopNode &node) const {
+            auto it = loops_.find(&node);
+            return it == loops_.end() ? nullptr : &it->second;
+        }
+
+    private:
+        // Only statements hold loops, expressions are not entered
+        class FindVisitor final : public node::WalkVisitor {
+        public:
+            FindVisitor(Analysis &analysis) : analysis_(analysis) {}
+
+            void Find(node::Node &root) {
+                Walk(root);
+            }
+
+            void Visit(node::LogicOpNode &node) override {}
+            void Visit(node::UnOpNode &node) override {}
+            void Visit(node::BinOpNode &node) override {}
+            void Visit(node::BinCompOpNode &node) override {}
+            void Visit(node::NumberNode &node) override {}
+            void Visit(node::InputNode &node) override {}
+            void Visit(node::VarNode &node) override {}
+
+            void Visit(node::ScopeNode &node) override {
+                DescendNext(node.kids_);
+            }
+
+            void Visit(node::DeclNode &node) override {}
+
+            void Visit(node::CondNode &node) override {
+                DescendNext({ node.first_, node.second_ });
+            }
+
+            void Visit(node::LoopNode &node) override {
+                if (GetStep() == 0) {
+                    if (auto loop = Summarize(node))
+                        analysis_.loops_.emplace(&node, std::move(*loop));
+                }
+                DescendNext({ node.scope_ });
+            }
+
+            void Visit(node::AssignNode &node) override {}
+            void Visit(node::OutputNode &node) override {}
+
+        private:
+            std::optional<Loop> Summarize(node::LoopNode &node) {
+                std::vector<node::Node*> body = { node.scope_ };
+                if (auto scope = dynamic_cast<node::ScopeNode*>(node.scope_))
+                    body = scope->kids_;
+
+                Loop loop;
+                for (auto statement : body) {
+                    auto assign = dynamic_cast<node::AssignNode*>(statement);
+                    if (assign == nullptr)
+                        return std::nullopt;
+                    auto name = assign->var_->name_;
+                    auto step = linear_.Build(*assign->expr_);
+                    if (!step || IsUpdated(loop, name))
+                        return std::nullopt;
+                    step->Add(LinearForm::Variable(name), -1);
+                    loop.updates.push_back({ name, std::move(*step), false });
+                }
+
+                for (auto &update : loop.updates) {
+                    update.counter = std::none_of(update.step.GetTerms().begin(), update.step.GetTerms().end(),
+                                                  [&loop](auto &term) { return IsUpdated(loop, term.name); });
+                }
+                for (auto &update : loop.updates) {
+                    for (auto &term : update.step.GetTerms()) {
+                        if (IsUpdated(loop, term.name) && !IsCounter(loop, term.name))
+                            return std::nullopt;
+                    }
+                }
+
+                auto predicat = dynamic_cast<node::BinCompOpNode*>(node.predicat_);
+                if (predicat == nullptr)
+                    return std::nullopt;
+                node::ExprNode *bound = nullptr;
+                if (auto var = dynamic_cast<node::VarNode*>(predicat->left_); var && IsCounter(loop, var->name_)) {
+                    loop.counter = var->name_;
+                    loop.relation = predicat->type_;
+                    bound = predicat->right_;
+                } else if (auto var = dynamic_cast<node::VarNode*>(predicat->right_); var && IsCounter(loop, var->name_)) {
+                    loop.counter = var->name_;
+                    loop.relation = details::Mirror(predicat->type_);
+                    bound = predicat->left_;
+                } else {
+                    return std::nullopt;
+                }
+                auto bound_form = linear_.Build(*bound);
+                if (!bound_form)
+                    return std::nullopt;
+                loop.bound = std::move(*bound_form);
+                for (auto &term : loop.bound.GetTerms()) {
+                    if (IsUpdated(loop, term.name))
+                        return std::nullopt;
+                }
+
+                for (auto &update : loop.updates) {
+                    AddRead(loop, update.name);
+                    for (auto &term : update.step.GetTerms())
+                        AddRead(loop, term.name);
+                }
+                for (auto &term : loop.bound.GetTerms())
+                    AddRead(loop, term.name);
+                return loop;
+            }
+
+            static bool IsUpdated(const Loop &loop, intern::Atom name) {
+                return std::any_of(loop.updates.begin(), loop.updates.end(), [name](auto &update) { return update.name == name; });
+            }
+
+            static bool IsCounter(const Loop &loop, intern::Atom name) {
+                return std::any_of(loop.updates.begin(), loop.updates.end(),
+                                   [name](auto &update) { return update.name == name && update.counter; });
+            }
+
+            static void AddRead(Loop &loop, intern::Atom name) {
+                if (std::find(loop.reads.begin(), loop.reads.end(), name) == loop.reads.end())
+                    loop.reads.push_back(name);
+            }
+
+            Analysis &analysis_;
+            details::LinearVisitor linear_;
+        }; // class FindVisitor
+
+        std::unordered_map<const node::LoopNode*, Loop> loops_;
+    }; // class Analysis
+} // namespace induction
@@ -0,0 +1,72 @@
+#pragma once
+#include <vector>
+#include <string_view>
+#include <unordered_map>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+
+namespace intern {
+    // Dense identifier of an interned name, valid for the Interner that issued it
+    using Atom = uint32_t;
+
+    // Maps identifiers to atoms numbered from zero in order of first
+    // appearance. Name texts are kept in large chunks that never move, so
+    // interning an already known name does not allocate.
+    class Interner final {
+    public:
+        Interner() = default;
+        Interner(const Interner&) = delete;
+        Interner &operator=(const Interner&) = delete;
+
+        Atom Intern(std::string_view name) {
+            auto hit = atoms_.find(name);
+            if (hit != atoms_.end())
+                return hit->second;
+
+            auto stored = Store(name);
+            auto atom = static_cast<Atom>(names_.size());
+            names_.push_back(stored);
+            atoms_.emplace(stored, atom);
+            return atom;
+        }
+
+        std::string_view GetName(Atom atom) const {
+            assert(atom < names_.size());
+            return names_[atom];
+        }
+
+        size_t GetSize() const {
+            return names_.size();
+        }
+
+    private:
+        static constexpr size_t CHUNK_SIZE = 16 * 1024;
+
+        std::string_view Store(std::string_view name) {
+            if (name.size() > CHUNK_SIZE / 4) {
+                // a long name gets a block of its own, the current chunk stays open
+                large_.push_back(std::make_unique<char[]>(name.size()));
+                std::memcpy(large_.back().get(), name.data(), name.size());
+                return std::string_view(large_.back().get(), name.size());
+            }
+
+            if (chunks_.empty() || name.size() > CHUNK_SIZE - used_) {
+                chunks_.push_back(std::make_unique<char[]>(CHUNK_SIZE));
+                used_ = 0;
+            }
+
+            char *place = chunks_.back().get() + used_;
+            std::memcpy(place, name.data(), name.size());
+            used_ += name.size();
+            return std::string_view(place, name.size());
+        }
+
+        std::vector<std::unique_ptr<char[]>> chunks_;
+        std::vector<std::unique_ptr<char[]>> large_;
+        size_t used_ = 0;
+        std::vector<std::string_view> names_;
+        std::unordered_map<std::string_view, Atom> atoms_;
+    }; // class Interner
+} // namespace intern
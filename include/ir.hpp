@@ -0,0 +1,410 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include <map>
+#include <ostream>
+#include <algorithm>
+#include <cstdint>
+#include <cassert>
+
+#include "location.hpp"
+
+namespace ir {
+    enum class Opcode {
+        Const,
+        Undef,
+
+        Input,
+        Copy,
+        Phi,
+
+        Neg,
+        Not,
+
+        Add,
+        Sub,
+        Mul,
+        Div,
+        Rem,
+
+        Eq,
+        Ne,
+        Gt,
+        Lt,
+        Ge,
+        Le,
+
+        IsDef,
+        CheckDef,
+        Print,
+
+        Jump,
+        Branch,
+        Ret
+    };
+
+    const static std::map<Opcode, std::string> OpcodeTexts = {
+        { Opcode::Const,    "const"    },
+        { Opcode::Undef,    "undef"    },
+        { Opcode::Input,    "input"    },
+        { Opcode::Copy,     "copy"     },
+        { Opcode::Phi,      "phi"      },
+        { Opcode::Neg,      "neg"      },
+        { Opcode::Not,      "not"      },
+        { Opcode::Add,      "add"      },
+        { Opcode::Sub,      "sub"      },
+        { Opcode::Mul,      "mul"      },
+        { Opcode::Div,      "div"      },
+        { Opcode::Rem,      "rem"      },
+        { Opcode::Eq,       "eq"       },
+        { Opcode::Ne,       "ne"       },
+        { Opcode::Gt,       "gt"       },
+        { Opcode::Lt,       "lt"       },
+        { Opcode::Ge,       "ge"       },
+        { Opcode::Le,       "le"       },
+        { Opcode::IsDef,    "isdef"    },
+        { Opcode::CheckDef, "checkdef" },
+        { Opcode::Print,    "print"    },
+        { Opcode::Jump,     "br"       },
+        { Opcode::Branch,   "condbr"   },
+        { Opcode::Ret,      "ret"      }
+    };
+
+    inline bool IsUnary(Opcode op) {
+        return op == Opcode::Neg || op == Opcode::Not;
+    }
+
+    inline bool IsBinary(Opcode op) {
+        return op >= Opcode::Add && op <= Opcode::Le;
+    }
+
+    inline bool IsCommutative(Opcode op) {
+        return op == Opcode::Add || op == Opcode::Mul || op == Opcode::Eq || op == Opcode::Ne;
+    }
+
+    // Arithmetic is done on 32-bit two's complement words, overflow wraps.
+    // The caller is responsible for rejecting zero divisors.
+    inline int Evaluate(Opcode op, int lhs, int rhs = 0) {
+        auto wrap = [](int64_t value) {
+            return static_cast<int>(static_cast<uint32_t>(value));
+        };
+
+        switch (op) {
+            case Opcode::Neg: return wrap(-int64_t(lhs));
+            case Opcode::Not: return !lhs;
+            case Opcode::Add: return wrap(int64_t(lhs) + rhs);
+            case Opcode::Sub: return wrap(int64_t(lhs) - rhs);
+            case Opcode::Mul: return wrap(int64_t(lhs) * rhs);
+            case Opcode::Div: assert(rhs != 0); return wrap(int64_t(lhs) / rhs);
+            case Opcode::Rem: assert(rhs != 0); return wrap(int64_t(lhs) % rhs);
+            case Opcode::Eq:  return lhs == rhs;
+            case Opcode::Ne:  return lhs != rhs;
+            case Opcode::Gt:  return lhs > rhs;
+            case Opcode::Lt:  return lhs < rhs;
+            case Opcode::Ge:  return lhs >= rhs;
+            case Opcode::Le:  return lhs <= rhs;
+            default:
+                assert(0 && "not an arithmetic opcode");
+                return 0;
+        }
+    }
+
+    struct BasicBlock;
+    struct Instruction;
+
+    // An operand slot of user that holds a value
+    struct Use final {
+        Instruction *user;
+        size_t operand;
+    }; // struct Use
+
+    // Every operand knows the position of its use in the value's list of
+    // users, so a use is dropped in constant time however many users the
+    // value has. The order of users is not meaningful.
+    struct Instruction final {
+        Instruction(Opcode op, size_t id, yy::Location location) : op_(op), id_(id), location_(location) {}
+
+        void AddOperand(Instruction *value) {
+            operands_.push_back(value);
+            use_positions_.push_back(value->users_.size());
+            value->users_.push_back({ this, operands_.size() - 1 });
+        }
+
+        void SetOperand(size_t index, Instruction *value) {
+            RemoveUse(index);
+            operands_[index] = value;
+            use_positions_[index] = value->users_.size();
+            value->users_.push_back({ this, index });
+        }
+
+        void RemoveOperand(size_t index) {
+            RemoveUse(index);
+            operands_.erase(operands_.begin() + index);
+            use_positions_.erase(use_positions_.begin() + index);
+            for (size_t i = index; i < operands_.size(); ++i)
+                operands_[i]->users_[use_positions_[i]].operand = i;
+        }
+
+        void DropOperands() {
+            for (size_t i = 0; i < operands_.size(); ++i)
+                RemoveUse(i);
+            operands_.clear();
+            use_positions_.clear();
+        }
+
+        void ReplaceAllUsesWith(Instruction *value) {
+            assert(value != this);
+            for (auto use : users_) {
+                use.user->operands_[use.operand] = value;
+                use.user->use_positions_[use.operand] = value->users_.size();
+                value->users_.push_back(use);
+            }
+            users_.clear();
+        }
+
+        bool IsConstant() const {
+            return op_ == Opcode::Const || op_ == Opcode::Undef;
+        }
+
+        bool IsTerminator() const {
+            return op_ == Opcode::Jump || op_ == Opcode::Branch || op_ == Opcode::Ret;
+        }
+
+        // Division traps on a zero divisor, so it may only be moved or
+        // removed when the divisor is a known non-zero constant.
+        bool MayTrap() const {
+            if (op_ == Opcode::Div || op_ == Opcode::Rem)
+                return !(operands_[1]->op_ == Opcode::Const && operands_[1]->imm_ != 0);
+            return op_ == Opcode::CheckDef;
+        }
+
+        bool HasSideEffects() const {
+            return op_ == Opcode::Input || op_ == Opcode::Print || IsTerminator() || MayTrap();
+        }
+
+        Opcode op_;
+        size_t id_;
+        int imm_ = 0;
+        std::vector<Instruction*> operands_;
+        std::vector<Use> users_;
+        std::vector<BasicBlock*> targets_;
+        BasicBlock *parent_ = nullptr;
+        std::string name_;
+        yy::Location location_;
+        bool erased_ = false;
+
+    private:
+        // The last use of the value takes the place of the removed one
+        void RemoveUse(size_t index) {
+            auto &users = operands_[index]->users_;
+            auto position = use_positions_[index];
+            assert(users[position].user == this && users[position].operand == index);
+            users[position] = users.back();
+            users[position].user->use_positions_[users[position].operand] = position;
+            users.pop_back();
+        }
+
+        std::vector<size_t> use_positions_;
+    }; // struct Instruction
+
+    struct BasicBlock final {
+        BasicBlock(size_t id) : id_(id) {}
+
+        Instruction *GetTerminator() const {
+            if (insts_.empty() || !insts_.back()->IsTerminator())
+                return nullptr;
+            return insts_.back();
+        }
+
+        const std::vector<BasicBlock*> &GetSuccessors() const {
+            static const std::vector<BasicBlock*> none;
+            auto term = GetTerminator();
+            return term ? term->targets_ : none;
+        }
+
+        size_t GetPredIndex(const BasicBlock *pred) const {
+            auto it = std::find(preds_.begin(), preds_.end(), pred);
+            assert(it != preds_.end());
+            return size_t(it - preds_.begin());
+        }
+
+        // Phi nodes are kept at the head of the block
+        size_t GetPhiCount() const {
+            size_t count = 0;
+            while (count < insts_.size() && insts_[count]->op_ == Opcode::Phi)
+                ++count;
+            return count;
+        }
+
+        size_t id_;
+        std::vector<Instruction*> insts_;
+        std::vector<BasicBlock*> preds_;
+        bool erased_ = false;
+    }; // struct BasicBlock
+
+    class Function final {
+    public:
+        Function() {
+            entry_ = CreateBlock();
+            undef_ = NewValue(Opcode::Undef, yy::Location{});
+        }
+
+        BasicBlock *CreateBlock() {
+            block_pool_.push_back(std::make_unique<BasicBlock>(block_pool_.size()));
+            blocks_.push_back(block_pool_.back().get());
+            return blocks_.back();
+        }
+
+        // Creates an instruction and appends it to the end of block
+        Instruction *Append(BasicBlock *block, Opcode op, yy::Location location = {}) {
+            auto inst = NewValue(op, location);
+            inst->parent_ = block;
+            block->insts_.push_back(inst);
+            return inst;
+        }
+
+        // Creates an instruction right before the terminator of block
+        Instruction *InsertBeforeTerminator(BasicBlock *block, Opcode op, yy::Location location = {}) {
+            auto inst = NewValue(op, location);
+            inst->parent_ = block;
+            auto pos = block->GetTerminator() ? block->insts_.end() - 1 : block->insts_.end();
+            block->insts_.insert(pos, inst);
+            return inst;
+        }
+
+        Instruction *PrependPhi(BasicBlock *block) {
+            auto phi = NewValue(Opcode::Phi, yy::Location{});
+            phi->parent_ = block;
+            block->insts_.insert(block->insts_.begin(), phi);
+            return phi;
+        }
+
+        void AddEdge(BasicBlock *from, BasicBlock *to) {
+            to->preds_.push_back(from);
+        }
+
+        // Removes from and the matching phi operands from to's predecessors
+        void RemoveEdge(BasicBlock *from, BasicBlock *to) {
+            size_t index = to->GetPredIndex(from);
+            to->preds_.erase(to->preds_.begin() + index);
+            for (size_t i = 0, phis = to->GetPhiCount(); i < phis; ++i)
+                to->insts_[i]->RemoveOperand(index);
+        }
+
+        Instruction *GetConst(int value) {
+            auto hit = consts_.find(value);
+            if (hit != consts_.end())
+                return hit->second;
+
+            auto inst = NewValue(Opcode::Const, yy::Location{});
+            inst->imm_ = value;
+            consts_.emplace(value, inst);
+            return inst;
+        }
+
+        Instruction *GetUndef() const {
+            return undef_;
+        }
+
+        // Marks inst as dead; it is unlinked from its block by Compact()
+        void Erase(Instruction *inst) {
+            assert(!inst->IsConstant());
+            inst->DropOperands();
+            inst->erased_ = true;
+        }
+
+        void EraseBlock(BasicBlock *block) {
+            for (auto inst : block->insts_) {
+                inst->DropOperands();
+                inst->erased_ = true;
+            }
+            block->erased_ = true;
+        }
+
+        void Compact() {
+            for (auto block : blocks_) {
+                auto &insts = block->insts_;
+                insts.erase(std::remove_if(insts.begin(), insts.end(), [](Instruction *inst) { return inst->erased_; }),
+                            insts.end());
+            }
+            blocks_.erase(std::remove_if(blocks_.begin(), blocks_.end(), [](BasicBlock *block) { return block->erased_; }),
+                          blocks_.end());
+        }
+
+        BasicBlock *GetEntry() const {
+            return entry_;
+        }
+
+        const std::vector<BasicBlock*> &GetBlocks() const {
+            return blocks_;
+        }
+
+        const std::map<int, Instruction*> &GetConsts() const {
+            return consts_;
+        }
+
+        size_t GetValueCount() const {
+            return values_.size();
+        }
+
+        size_t GetBlockCount() const {
+            return block_pool_.size();
+        }
+
+        void Dump(std::ostream &out) const {
+            for (auto [value, inst] : consts_)
+                out << "%" << inst->id_ << " = const " << value << "\n";
+            out << "%" << undef_->id_ << " = undef\n";
+
+            for (auto block : blocks_) {
+                out << "\nbb" << block->id_ << ":";
+                if (!block->preds_.empty()) {
+                    out << "\t\t; preds:";
+                    for (auto pred : block->preds_)
+                        out << " bb" << pred->id_;
+                }
+                out << "\n";
+
+                for (auto inst : block->insts_)
+                    DumpInstruction(out, *inst);
+            }
+        }
+
+    private:
+        Instruction *NewValue(Opcode op, yy::Location location) {
+            values_.push_back(std::make_unique<Instruction>(op, values_.size(), location));
+            return values_.back().get();
+        }
+
+        void DumpInstruction(std::ostream &out, const Instruction &inst) const {
+            out << "\t";
+            bool has_value = !inst.IsTerminator() && inst.op_ != Opcode::Print && inst.op_ != Opcode::CheckDef;
+            if (has_value)
+                out << "%" << inst.id_ << " = ";
+            out << OpcodeTexts.at(inst.op_);
+
+            for (size_t i = 0; i < inst.operands_.size(); ++i) {
+                out << (i ? ", " : " ");
+                if (inst.op_ == Opcode::Phi)
+                    out << "[%" << inst.operands_[i]->id_ << ", bb" << inst.parent_->preds_[i]->id_ << "]";
+                else
+                    out << "%" << inst.operands_[i]->id_;
+            }
+
+            for (size_t i = 0; i < inst.targets_.size(); ++i)
+                out << ((i || !inst.operands_.empty()) ? ", " : " ") << "bb" << inst.targets_[i]->id_;
+
+            if (!inst.name_.empty())
+                out << "\t\t; " << inst.name_;
+            out << "\n";
+        }
+
+        std::vector<std::unique_ptr<Instruction>> values_;
+        std::vector<std::unique_ptr<BasicBlock>> block_pool_;
+        std::vector<BasicBlock*> blocks_;
+        std::map<int, Instruction*> consts_;
+        BasicBlock *entry_ = nullptr;
+        Instruction *undef_ = nullptr;
+    }; // class Function
+} // namespace ir
@@ -0,0 +1,129 @@
+#pragma once
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <exception>
+#include <cstdint>
+#include <cassert>
+
+#include "error_handler.hpp"
+#include "ir.hpp"
+
+namespace ir {
+    // Interprets a function in SSA form. Registers are indexed by value id,
+    // undef is encoded as a value that no 32-bit integer can take.
+    class Executer final {
+    public:
+        Executer(const Function &function, const err::ErrorHandler &err_handler, std::istream &in, std::ostream &out) :
+            function_(function), err_handler_(err_handler), in_(in), out_(out) {}
+
+        void Execute() {
+            regs_.assign(function_.GetValueCount(), UNDEF);
+            for (auto [value, inst] : function_.GetConsts())
+                regs_[inst->id_] = value;
+
+            BasicBlock *prev = nullptr;
+            BasicBlock *block = function_.GetEntry();
+            while (block != nullptr) {
+                size_t phis = block->GetPhiCount();
+                if (phis != 0)
+                    ExecutePhis(*block, *prev, phis);
+
+                BasicBlock *next = nullptr;
+                for (size_t i = phis, size = block->insts_.size(); i < size; ++i) {
+                    auto &inst = *block->insts_[i];
+                    if (inst.IsTerminator()) {
+                        next = ExecuteTerminator(inst);
+                        break;
+                    }
+                    ExecuteInstruction(inst);
+                }
+
+                prev = block;
+                block = next;
+            }
+        }
+
+    private:
+        static constexpr int64_t UNDEF = INT64_MIN;
+
+        // All phis of a block read their operands before any of them is written
+        void ExecutePhis(const BasicBlock &block, const BasicBlock &pred, size_t phis) {
+            size_t index = block.GetPredIndex(&pred);
+            phi_values_.resize(phis);
+            for (size_t i = 0; i < phis; ++i)
+                phi_values_[i] = regs_[block.insts_[i]->operands_[index]->id_];
+            for (size_t i = 0; i < phis; ++i)
+                regs_[block.insts_[i]->id_] = phi_values_[i];
+        }
+
+        BasicBlock *ExecuteTerminator(const Instruction &inst) {
+            switch (inst.op_) {
+                case Opcode::Jump:
+                    return inst.targets_[0];
+                case Opcode::Branch:
+                    return Get(inst, 0) ? inst.targets_[0] : inst.targets_[1];
+                default:
+                    return nullptr;
+            }
+        }
+
+        void ExecuteInstruction(const Instruction &inst) {
+            auto &result = regs_[inst.id_];
+            switch (inst.op_) {
+                case Opcode::Input: {
+                    int input = 0;
+                    in_ >> input;
+                    result = input;
+                    return;
+                }
+                case Opcode::Copy:
+                    result = regs_[inst.operands_[0]->id_];
+                    return;
+                case Opcode::IsDef:
+                    result = regs_[inst.operands_[0]->id_] != UNDEF;
+                    return;
+                case Opcode::CheckDef:
+                    if (regs_[inst.operands_[0]->id_] == UNDEF) {
+                        throw std::runtime_error(err_handler_.GetFullErrorMessage("Runtime error", \
+                                    std::string("'" + inst.name_ + "' was not declared in this scope"), \
+                                    inst.location_));
+                    }
+                    return;
+                case Opcode::Print:
+                    out_ << Get(inst, 0) << std::endl;
+                    return;
+                case Opcode::Div:
+                case Opcode::Rem:
+                    if (Get(inst, 1) == 0) {
+                        throw std::runtime_error(err_handler_.GetFullErrorMessage("Runtime error", \
+                                                                                "Division by zero", \
+                                                                                inst.location_));
+                    }
+                    result = Evaluate(inst.op_, Get(inst, 0), Get(inst, 1));
+                    return;
+                default:
+                    if (IsUnary(inst.op_))
+                        result = Evaluate(inst.op_, Get(inst, 0));
+                    else if (IsBinary(inst.op_))
+                        result = Evaluate(inst.op_, Get(inst, 0), Get(inst, 1));
+                    else
+                        assert(0 && "unexpected instruction");
+                    return;
+            }
+        }
+
+        // Hoisted computations may speculatively consume undef, their results
+        // are never observed because the guarding checkdef traps first
+        int Get(const Instruction &inst, size_t index) const {
+            return static_cast<int>(regs_[inst.operands_[index]->id_]);
+        }
+
+        const Function &function_;
+        const err::ErrorHandler &err_handler_;
+        std::istream &in_;
+        std::ostream &out_;
+        std::vector<int64_t> regs_;
+        std::vector<int64_t> phi_values_;
+    }; // class Executer
+} // namespace ir
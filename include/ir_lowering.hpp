@@ -0,0 +1,615 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <cassert>
+
+#include "ir.hpp"
+#include "node.hpp"
+#include "name_resolver.hpp"
+
+namespace ir {
+    // Lowers the AST into a CFG in SSA form. SSA is built on the fly while
+    // walking the tree, following Braun et al. "Simple and Efficient
+    // Construction of Static Single Assignment Form": a block is sealed once
+    // all of its predecessors are known and variable reads are resolved by
+    // walking up the predecessors, placing phi nodes only where needed.
+    //
+    // Names are bound to per-scope slots by resolver::NameResolver. Leaving
+    // a scope redefines its slots as undef, so a value never leaks into the
+    // next iteration of a loop. Only names that may be unassigned get isdef
+    // tests and checkdef guards.
+    class LowerVisitor final : public node::WalkVisitor {
+    public:
+        LowerVisitor(Function &function, const intern::Interner &interner) : function_(function), interner_(interner) {
+            current_ = function_.GetEntry();
+            RegisterBlock(current_);
+            sealed_[current_->id_] = true;
+        }
+
+        void Lower(node::Node &root) {
+            Walk(root);
+            function_.Append(current_, Opcode::Ret);
+            function_.Compact();
+        }
+
+        void Visit(node::LogicOpNode &node) override {
+            switch (GetStep()) {
+                case 0:
+                    assert(node.left_);
+                    Descend(*node.left_, 1);
+                    return;
+                case 1: {
+                    auto left = value_;
+                    auto rhs = NewBlock();
+                    auto &pending = PushPending();
+                    pending.second = NewBlock();
+                    // the value of the whole expression when the right operand is skipped
+                    pending.value = function_.GetConst(node.type_ == node::LogicOpNode_t::logic_or);
+                    if (node.type_ == node::LogicOpNode_t::logic_and)
+                        Branch(left, rhs, pending.second);
+                    else
+                        Branch(left, pending.second, rhs);
+
+                    Seal(rhs);
+                    current_ = rhs;
+                    pending.mark = resolver_.Mark();
+                    assert(node.right_);
+                    Descend(*node.right_, 2);
+                    return;
+                }
+                default: {
+                    auto pending = PopPending();
+                    resolver_.Undo(pending.mark);
+                    auto right = Emit(Opcode::Ne, node.location_, value_, function_.GetConst(0));
+                    auto rhs_end = current_;
+                    auto join = pending.second;
+                    Jump(join);
+
+                    Seal(join);
+                    current_ = join;
+                    auto phi = function_.PrependPhi(join);
+                    for (auto pred : join->preds_)
+                        phi->AddOperand(pred == rhs_end ? right : pending.value);
+                    value_ = phi;
+                    return;
+                }
+            }
+        }
+
+        void Visit(node::UnOpNode &node) override {
+            if (GetStep() == 0) {
+                assert(node.child_);
+                Descend(*node.child_, 1);
+                return;
+            }
+
+            switch (node.type_) {
+                case node::UnOpNode_t::minus:
+                    value_ = Emit(Opcode::Neg, node.location_, value_);
+                    return;
+                case node::UnOpNode_t::negation:
+                    value_ = Emit(Opcode::Not, node.location_, value_);
+                    return;
+            }
+        }
+
+        void Visit(node::BinOpNode &node) override {
+            Instruction *left = nullptr;
+            if (!LowerOperands(node, left))
+                return;
+            auto right = value_;
+
+            switch (node.type_) {
+                case node::BinOpNode_t::add:
+                    value_ = Emit(Opcode::Add, node.location_, left, right);
+                    return;
+                case node::BinOpNode_t::sub:
+                    value_ = Emit(Opcode::Sub, node.location_, left, right);
+                    return;
+                case node::BinOpNode_t::mul:
+                    value_ = Emit(Opcode::Mul, node.location_, left, right);
+                    return;
+                case node::BinOpNode_t::div:
+                    value_ = Emit(Opcode::Div, node.location_, left, right);
+                    return;
+                case node::BinOpNode_t::remainder:
+                    value_ = Emit(Opcode::Rem, node.location_, left, right);
+                    return;
+            }
+        }
+
+        void Visit(node::BinCompOpNode &node) override {
+            Instruction *left = nullptr;
+            if (!LowerOperands(node, left))
+                return;
+            auto right = value_;
+
+            switch (node.type_) {
+                case node::BinCompOpNode_t::equal:
+                    value_ = Emit(Opcode::Eq, node.location_, left, right);
+                    return;
+                case node::BinCompOpNode_t::not_equal:
+                    value_ = Emit(Opcode::Ne, node.location_, left, right);
+                    return;
+                case node::BinCompOpNode_t::greater:
+                    value_ = Emit(Opcode::Gt, node.location_, left, right);
+                    return;
+                case node::BinCompOpNode_t::less:
+                    value_ = Emit(Opcode::Lt, node.location_, left, right);
+                    return;
+                case node::BinCompOpNode_t::greater_or_equal:
+                    value_ = Emit(Opcode::Ge, node.location_, left, right);
+                    return;
+                case node::BinCompOpNode_t::less_or_equal:
+                    value_ = Emit(Opcode::Le, node.location_, left, right);
+                    return;
+            }
+        }
+
+        void Visit(node::NumberNode &node) override {
+            value_ = function_.GetConst(node.number_);
+        }
+
+        void Visit(node::InputNode &node) override {
+            value_ = function_.Append(current_, Opcode::Input, node.location_);
+        }
+
+        void Visit(node::VarNode &node) override {
+            auto slots = resolver_.GetCandidateSlots(node.name_);
+            if (!slots.empty() && resolver_.IsDefinite(slots.front())) {
+                value_ = ReadVariable(slots.front(), current_);
+                return;
+            }
+
+            auto value = ReadFirstAssigned(slots);
+            auto check = Emit(Opcode::CheckDef, node.location_, value);
+            check->name_ = interner_.GetName(node.name_);
+            value_ = value;
+        }
+
+        void Visit(node::ScopeNode &node) override {
+            if (GetStep() == 0)
+                resolver_.PushScope();
+            if (DescendNext(node.kids_))
+                return;
+
+            for (auto slot : resolver_.PopScope())
+                WriteVariable(slot, current_, function_.GetUndef());
+        }
+
+        void Visit(node::DeclNode &node) override {}
+
+        void Visit(node::CondNode &node) override {
+            switch (GetStep()) {
+                case 0:
+                    assert(node.predicat_);
+                    Descend(*node.predicat_, 1);
+                    return;
+                case 1: {
+                    auto cond = value_;
+                    auto then_block = NewBlock();
+                    auto &pending = PushPending();
+                    pending.first = node.second_ ? NewBlock() : nullptr;
+                    pending.second = NewBlock();
+                    Branch(cond, then_block, pending.first ? pending.first : pending.second);
+
+                    pending.mark = resolver_.Mark();
+                    Seal(then_block);
+                    current_ = then_block;
+                    assert(node.first_);
+                    Descend(*node.first_, 2);
+                    return;
+                }
+                case 2: {
+                    auto &pending = pending_.back();
+                    Jump(pending.second);
+                    pending.assigned = resolver_.Undo(pending.mark);
+                    if (pending.first) {
+                        Seal(pending.first);
+                        current_ = pending.first;
+                        Descend(*node.second_, 3);
+                        return;
+                    }
+                    break;
+                }
+                default: {
+                    auto &pending = pending_.back();
+                    Jump(pending.second);
+                    resolver_.Join(pending.assigned, resolver_.Undo(pending.mark));
+                    break;
+                }
+            }
+
+            auto join = PopPending().second;
+            Seal(join);
+            current_ = join;
+        }
+
+        void Visit(node::LoopNode &node) override {
+            switch (GetStep()) {
+                case 0: {
+                    auto &pending = PushPending();
+                    pending.first = NewBlock();
+                    Jump(pending.first);
+                    current_ = pending.first;
+
+                    assert(node.predicat_);
+                    Descend(*node.predicat_, 1);
+                    return;
+                }
+                case 1: {
+                    auto &pending = pending_.back();
+                    auto cond = value_;
+                    auto body = NewBlock();
+                    pending.second = NewBlock();
+                    Branch(cond, body, pending.second);
+
+                    pending.mark = resolver_.Mark();
+                    Seal(body);
+                    current_ = body;
+                    assert(node.scope_);
+                    Descend(*node.scope_, 2);
+                    return;
+                }
+                default: {
+                    auto pending = PopPending();
+                    auto header = pending.first;
+                    auto exit = pending.second;
+                    Jump(header);
+                    resolver_.Undo(pending.mark);
+
+                    Seal(header);
+                    Seal(exit);
+                    current_ = exit;
+                    return;
+                }
+            }
+        }
+
+        void Visit(node::AssignNode &node) override {
+            if (GetStep() == 0) {
+                assert(node.expr_);
+                Descend(*node.expr_, 1);
+                return;
+            }
+            assert(node.var_);
+
+            auto copy = Emit(Opcode::Copy, node.location_, value_);
+            copy->name_ = interner_.GetName(node.var_->name_);
+            AssignFirstAssigned(node.var_->name_, copy);
+            value_ = copy;
+        }
+
+        void Visit(node::OutputNode &node) override {
+            if (GetStep() == 0) {
+                assert(node.expr_);
+                Descend(*node.expr_, 1);
+                return;
+            }
+            Emit(Opcode::Print, node.location_, value_);
+        }
+
+    private:
+        // What a node keeps between its steps: a value, up to two blocks
+        // still to be finished and the state of the resolver
+        struct Pending final {
+            Instruction *value = nullptr;
+            BasicBlock *first = nullptr;
+            BasicBlock *second = nullptr;
+            size_t mark = 0;
+            std::vector<size_t> assigned;
+        }; // struct Pending
+
+        // A phi whose operands are read, with the blocks to define as its
+        // value once it is filled
+        struct PhiFill final {
+            Instruction *phi = nullptr;
+            size_t next = 0;
+            std::vector<BasicBlock*> chain;
+        }; // struct PhiFill
+
+        Pending &PushPending() {
+            return pending_.emplace_back();
+        }
+
+        Pending PopPending() {
+            auto pending = std::move(pending_.back());
+            pending_.pop_back();
+            return pending;
+        }
+
+        // Schedules the left and then the right operand, the value of the
+        // left one is kept in a pending. True once both are lowered.
+        template <typename Node>
+        bool LowerOperands(Node &node, Instruction *&left) {
+            switch (GetStep()) {
+                case 0:
+                    assert(node.left_);
+                    Descend(*node.left_, 1);
+                    return false;
+                case 1:
+                    PushPending().value = value_;
+                    assert(node.right_);
+                    Descend(*node.right_, 2);
+                    return false;
+                default:
+                    left = PopPending().value;
+                    return true;
+            }
+        }
+
+        // Reads the innermost assigned slot, undef if there is none
+        Instruction *ReadFirstAssigned(const std::vector<size_t> &slots) {
+            if (slots.empty())
+                return function_.GetUndef();
+            if (slots.size() == 1)
+                return ReadVariable(slots.front(), current_);
+
+            auto join = NewBlock();
+            std::vector<std::pair<BasicBlock*, Instruction*>> incoming;
+            for (auto slot : slots) {
+                auto value = ReadVariable(slot, current_);
+                incoming.emplace_back(current_, value);
+                if (resolver_.IsDefinite(slot)) {
+                    Jump(join);
+                    break;
+                }
+
+                auto next = NewBlock();
+                Branch(Emit(Opcode::IsDef, yy::Location{}, value), join, next);
+                Seal(next);
+                current_ = next;
+            }
+
+            if (!resolver_.IsDefinite(slots.back())) {
+                incoming.emplace_back(current_, function_.GetUndef());
+                Jump(join);
+            }
+
+            Seal(join);
+            current_ = join;
+            auto phi = function_.PrependPhi(join);
+            for (auto pred : join->preds_) {
+                auto hit = std::find_if(incoming.begin(), incoming.end(), [pred](auto &edge) { return edge.first == pred; });
+                phi->AddOperand(Resolve(hit->second));
+            }
+            return phi;
+        }
+
+        // Stores into the innermost assigned slot or declares the name in the
+        // current scope
+        void AssignFirstAssigned(intern::Atom name, Instruction *value) {
+            auto slots = resolver_.GetCandidateSlots(name);
+            if (resolver_.IsStaticStore(name, slots)) {
+                auto slot = slots.empty() ? resolver_.GetLocalSlot(name) : slots.front();
+                WriteVariable(slot, current_, value);
+                resolver_.SetDefinite(slot);
+                return;
+            }
+
+            auto join = NewBlock();
+            for (auto slot : slots) {
+                if (resolver_.IsDefinite(slot)) {
+                    WriteVariable(slot, current_, value);
+                    Jump(join);
+                    break;
+                }
+
+                auto store = NewBlock();
+                auto next = NewBlock();
+                Branch(Emit(Opcode::IsDef, yy::Location{}, ReadVariable(slot, current_)), store, next);
+                Seal(store);
+                current_ = store;
+                WriteVariable(slot, current_, value);
+                Jump(join);
+
+                Seal(next);
+                current_ = next;
+            }
+
+            if (!resolver_.IsDefinite(slots.back())) {
+                WriteVariable(resolver_.GetLocalSlot(name), current_, value);
+                Jump(join);
+            }
+
+            Seal(join);
+            current_ = join;
+        }
+
+        template <typename... Operands>
+        Instruction *Emit(Opcode op, yy::Location location, Operands... operands) {
+            auto inst = function_.Append(current_, op, location);
+            (inst->AddOperand(Resolve(operands)), ...);
+            return inst;
+        }
+
+        BasicBlock *NewBlock() {
+            auto block = function_.CreateBlock();
+            RegisterBlock(block);
+            return block;
+        }
+
+        void RegisterBlock(BasicBlock *block) {
+            defs_.resize(block->id_ + 1);
+            incomplete_phis_.resize(block->id_ + 1);
+            sealed_.resize(block->id_ + 1, false);
+        }
+
+        void Jump(BasicBlock *target) {
+            auto jump = function_.Append(current_, Opcode::Jump);
+            jump->targets_.push_back(target);
+            function_.AddEdge(current_, target);
+        }
+
+        void Branch(Instruction *cond, BasicBlock *on_true, BasicBlock *on_false) {
+            auto branch = Emit(Opcode::Branch, yy::Location{}, cond);
+            branch->targets_ = {on_true, on_false};
+            function_.AddEdge(current_, on_true);
+            function_.AddEdge(current_, on_false);
+        }
+
+        // Follows the chain of trivial phis that were replaced by other values
+        Instruction *Resolve(Instruction *value) const {
+            for (auto hit = replaced_.find(value); hit != replaced_.end(); hit = replaced_.find(value))
+                value = hit->second;
+            return value;
+        }
+
+        void WriteVariable(size_t slot, BasicBlock *block, Instruction *value) {
+            defs_[block->id_][slot] = value;
+        }
+
+        // Reading a variable fills phis at joins with what the predecessors
+        // hold, which may place more phis further up. The phis being filled
+        // are kept on an explicit stack, so long chains of joins do not
+        // exhaust the call stack.
+        Instruction *ReadVariable(size_t slot, BasicBlock *block) {
+            std::vector<PhiFill> fills;
+            auto value = LookUp(slot, block, fills);
+            return value != nullptr ? value : FillPhis(slot, fills);
+        }
+
+        Instruction *AddPhiOperands(size_t slot, Instruction *phi) {
+            std::vector<PhiFill> fills;
+            fills.push_back({ phi, 0, {} });
+            return FillPhis(slot, fills);
+        }
+
+        // The value of the slot in the block, or nullptr when a phi was
+        // placed at a sealed join and pushed to be filled
+        Instruction *LookUp(size_t slot, BasicBlock *block, std::vector<PhiFill> &fills) {
+            // single predecessor chains are walked without recursion
+            std::vector<BasicBlock*> chain;
+            Instruction *value = nullptr;
+            for (;;) {
+                auto &defs = defs_[block->id_];
+                auto hit = defs.find(slot);
+                if (hit != defs.end()) {
+                    value = Resolve(hit->second);
+                    break;
+                }
+
+                if (!sealed_[block->id_]) {
+                    value = function_.PrependPhi(block);
+                    incomplete_phis_[block->id_].emplace_back(slot, value);
+                    WriteVariable(slot, block, value);
+                    break;
+                }
+
+                if (block->preds_.empty()) {
+                    value = function_.GetUndef();
+                    break;
+                }
+
+                if (block->preds_.size() == 1) {
+                    chain.push_back(block);
+                    block = block->preds_.front();
+                    continue;
+                }
+
+                auto phi = function_.PrependPhi(block);
+                WriteVariable(slot, block, phi);
+                chain.push_back(block);
+                fills.push_back({ phi, 0, std::move(chain) });
+                return nullptr;
+            }
+
+            for (auto link : chain)
+                WriteVariable(slot, link, value);
+            return value;
+        }
+
+        // Reads the operands of the phi on top of the stack one predecessor
+        // after another, a read that places a phi pushes it on top
+        Instruction *FillPhis(size_t slot, std::vector<PhiFill> &fills) {
+            Instruction *value = nullptr;
+            for (;;) {
+                auto &fill = fills.back();
+                // the operand of the predecessor read last
+                if (value != nullptr) {
+                    fill.phi->AddOperand(value);
+                    ++fill.next;
+                }
+
+                auto &preds = fill.phi->parent_->preds_;
+                if (fill.next < preds.size()) {
+                    value = LookUp(slot, preds[fill.next], fills);
+                    continue;
+                }
+
+                value = TryRemoveTrivialPhi(fill.phi);
+                for (auto link : fill.chain)
+                    WriteVariable(slot, link, value);
+                fills.pop_back();
+                if (fills.empty())
+                    return value;
+            }
+        }
+
+        // Removing a trivial phi may make the phis that use it trivial, they
+        // are checked from a worklist
+        Instruction *TryRemoveTrivialPhi(Instruction *phi) {
+            std::vector<Instruction*> worklist = { phi };
+            while (!worklist.empty()) {
+                auto current = worklist.back();
+                worklist.pop_back();
+                if (current->erased_)
+                    continue;
+
+                Instruction *same = nullptr;
+                bool trivial = true;
+                for (auto operand : current->operands_) {
+                    if (operand == same || operand == current)
+                        continue;
+                    if (same != nullptr) {
+                        trivial = false;
+                        break;
+                    }
+                    same = operand;
+                }
+                if (!trivial)
+                    continue;
+
+                if (same == nullptr)
+                    same = function_.GetUndef();
+
+                auto size = worklist.size();
+                for (auto [user, operand] : current->users_) {
+                    if (user != current && user->op_ == Opcode::Phi)
+                        worklist.push_back(user);
+                }
+                // users are checked in the order they were found
+                std::reverse(worklist.begin() + size, worklist.end());
+
+                current->ReplaceAllUsesWith(same);
+                function_.Erase(current);
+                replaced_[current] = same;
+            }
+            // the phi resolves to itself unless it was removed
+            return Resolve(phi);
+        }
+
+        void Seal(BasicBlock *block) {
+            auto incomplete = std::move(incomplete_phis_[block->id_]);
+            incomplete_phis_[block->id_].clear();
+            for (auto [slot, phi] : incomplete)
+                AddPhiOperands(slot, phi);
+            sealed_[block->id_] = true;
+        }
+
+        Function &function_;
+        const intern::Interner &interner_;
+        BasicBlock *current_ = nullptr;
+        Instruction *value_ = nullptr;
+
+        resolver::NameResolver resolver_;
+        std::vector<Pending> pending_;
+
+        std::vector<std::unordered_map<size_t, Instruction*>> defs_;
+        std::vector<std::vector<std::pair<size_t, Instruction*>>> incomplete_phis_;
+        std::vector<bool> sealed_;
+        std::unordered_map<Instruction*, Instruction*> replaced_;
+    }; // class LowerVisitor
+} // namespace ir
@@ -0,0 +1,656 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <algorithm>
+#include <cassert>
+
+#include "ir.hpp"
+
+namespace ir {
+    // Cooper, Harvey and Kennedy "A Simple, Fast Dominance Algorithm"
+    class DominatorTree final {
+    public:
+        DominatorTree(const Function &function) {
+            size_t count = function.GetBlockCount();
+            idom_.assign(count, nullptr);
+            rpo_index_.assign(count, UNREACHABLE);
+            children_.assign(count, {});
+            enter_.assign(count, 0);
+            leave_.assign(count, 0);
+
+            BuildRPO(function.GetEntry());
+            BuildIdoms(function.GetEntry());
+            NumberTree(function.GetEntry());
+        }
+
+        const std::vector<BasicBlock*> &GetRPO() const {
+            return rpo_;
+        }
+
+        bool IsReachable(const BasicBlock *block) const {
+            return rpo_index_[block->id_] != UNREACHABLE;
+        }
+
+        size_t GetRPOIndex(const BasicBlock *block) const {
+            return rpo_index_[block->id_];
+        }
+
+        BasicBlock *GetIdom(const BasicBlock *block) const {
+            return idom_[block->id_];
+        }
+
+        const std::vector<BasicBlock*> &GetChildren(const BasicBlock *block) const {
+            return children_[block->id_];
+        }
+
+        bool Dominates(const BasicBlock *dom, const BasicBlock *block) const {
+            return enter_[dom->id_] <= enter_[block->id_] && leave_[block->id_] <= leave_[dom->id_];
+        }
+
+    private:
+        static constexpr size_t UNREACHABLE = size_t(-1);
+
+        void BuildRPO(BasicBlock *entry) {
+            std::vector<bool> visited(rpo_index_.size(), false);
+            std::vector<std::pair<BasicBlock*, size_t>> stack{{entry, 0}};
+            visited[entry->id_] = true;
+
+            while (!stack.empty()) {
+                auto &[block, next] = stack.back();
+                auto &succs = block->GetSuccessors();
+                if (next < succs.size()) {
+                    auto succ = succs[next++];
+                    if (!visited[succ->id_]) {
+                        visited[succ->id_] = true;
+                        stack.emplace_back(succ, 0);
+                    }
+                    continue;
+                }
+                rpo_.push_back(block);
+                stack.pop_back();
+            }
+
+            std::reverse(rpo_.begin(), rpo_.end());
+            for (size_t i = 0; i < rpo_.size(); ++i)
+                rpo_index_[rpo_[i]->id_] = i;
+        }
+
+        void BuildIdoms(BasicBlock *entry) {
+            idom_[entry->id_] = entry;
+            for (bool changed = true; changed; ) {
+                changed = false;
+                for (size_t i = 1; i < rpo_.size(); ++i) {
+                    auto block = rpo_[i];
+                    BasicBlock *new_idom = nullptr;
+                    for (auto pred : block->preds_) {
+                        if (!IsReachable(pred) || idom_[pred->id_] == nullptr)
+                            continue;
+                        new_idom = new_idom ? Intersect(pred, new_idom) : pred;
+                    }
+
+                    if (idom_[block->id_] != new_idom) {
+                        idom_[block->id_] = new_idom;
+                        changed = true;
+                    }
+                }
+            }
+
+            for (size_t i = 1; i < rpo_.size(); ++i)
+                children_[idom_[rpo_[i]->id_]->id_].push_back(rpo_[i]);
+        }
+
+        BasicBlock *Intersect(BasicBlock *lhs, BasicBlock *rhs) const {
+            while (lhs != rhs) {
+                while (rpo_index_[lhs->id_] > rpo_index_[rhs->id_])
+                    lhs = idom_[lhs->id_];
+                while (rpo_index_[rhs->id_] > rpo_index_[lhs->id_])
+                    rhs = idom_[rhs->id_];
+            }
+            return lhs;
+        }
+
+        void NumberTree(BasicBlock *entry) {
+            size_t counter = 0;
+            std::vector<std::pair<BasicBlock*, size_t>> stack{{entry, 0}};
+            enter_[entry->id_] = counter++;
+
+            while (!stack.empty()) {
+                auto &[block, next] = stack.back();
+                auto &kids = children_[block->id_];
+                if (next < kids.size()) {
+                    auto kid = kids[next++];
+                    enter_[kid->id_] = counter++;
+                    stack.emplace_back(kid, 0);
+                    continue;
+                }
+                leave_[block->id_] = counter++;
+                stack.pop_back();
+            }
+        }
+
+        std::vector<BasicBlock*> rpo_;
+        std::vector<size_t> rpo_index_;
+        std::vector<BasicBlock*> idom_;
+        std::vector<std::vector<BasicBlock*>> children_;
+        std::vector<size_t> enter_;
+        std::vector<size_t> leave_;
+    }; // class DominatorTree
+
+    struct Loop final {
+        static constexpr size_t NONE = size_t(-1);
+
+        BasicBlock *header_ = nullptr;
+        size_t parent_ = NONE;
+        // blocks this loop is the innermost one of, in reverse post order
+        std::vector<BasicBlock*> blocks_;
+        std::vector<size_t> children_;
+        // numbering of the forest, a loop holds the loops numbered within it
+        size_t enter_ = 0;
+        size_t leave_ = 0;
+    }; // struct Loop
+
+    // Natural loops nested in a forest, built in one pass over the headers
+    // from the innermost out: the body walk of a loop steps over a nested
+    // loop found before from its latches to its header.
+    class LoopForest final {
+    public:
+        LoopForest(const Function &function, const DominatorTree &dom_tree) {
+            loop_of_.assign(function.GetBlockCount(), Loop::NONE);
+            auto &rpo = dom_tree.GetRPO();
+            for (auto it = rpo.rbegin(); it != rpo.rend(); ++it)
+                AddLoop(*it, dom_tree);
+
+            for (auto block : rpo) {
+                if (loop_of_[block->id_] != Loop::NONE)
+                    loops_[loop_of_[block->id_]].blocks_.push_back(block);
+            }
+            NumberForest();
+        }
+
+        // Innermost loops first, every loop comes before the ones around it
+        std::vector<Loop> &GetLoops() {
+            return loops_;
+        }
+
+        bool Contains(const Loop &loop, const BasicBlock *block) const {
+            if (block == nullptr || loop_of_[block->id_] == Loop::NONE)
+                return false;
+            auto &inner = loops_[loop_of_[block->id_]];
+            return loop.enter_ <= inner.enter_ && inner.leave_ <= loop.leave_;
+        }
+
+    private:
+        void AddLoop(BasicBlock *header, const DominatorTree &dom_tree) {
+            std::vector<BasicBlock*> worklist;
+            for (auto pred : header->preds_) {
+                if (dom_tree.IsReachable(pred) && dom_tree.Dominates(header, pred))
+                    worklist.push_back(pred);
+            }
+            if (worklist.empty())
+                return;
+
+            auto index = loops_.size();
+            loops_.emplace_back().header_ = header;
+            outermost_.push_back(index);
+            loop_of_[header->id_] = index;
+            while (!worklist.empty()) {
+                auto block = worklist.back();
+                worklist.pop_back();
+                if (!dom_tree.IsReachable(block))
+                    continue;
+                if (loop_of_[block->id_] == Loop::NONE) {
+                    loop_of_[block->id_] = index;
+                    worklist.insert(worklist.end(), block->preds_.begin(), block->preds_.end());
+                    continue;
+                }
+
+                // a loop found before is nested in this one, its body is
+                // entered through its header
+                auto inner = FindOutermost(loop_of_[block->id_]);
+                if (inner == index)
+                    continue;
+                loops_[inner].parent_ = index;
+                loops_[index].children_.push_back(inner);
+                outermost_[inner] = index;
+                auto inner_header = loops_[inner].header_;
+                worklist.insert(worklist.end(), inner_header->preds_.begin(), inner_header->preds_.end());
+            }
+        }
+
+        size_t FindOutermost(size_t loop) {
+            while (outermost_[loop] != loop)
+                loop = outermost_[loop] = outermost_[outermost_[loop]];
+            return loop;
+        }
+
+        void NumberForest() {
+            size_t counter = 0;
+            std::vector<std::pair<size_t, size_t>> stack;
+            for (size_t root = 0; root < loops_.size(); ++root) {
+                if (loops_[root].parent_ != Loop::NONE)
+                    continue;
+                loops_[root].enter_ = counter++;
+                stack.emplace_back(root, 0);
+                while (!stack.empty()) {
+                    auto &[loop, next] = stack.back();
+                    auto &kids = loops_[loop].children_;
+                    if (next < kids.size()) {
+                        auto kid = kids[next++];
+                        loops_[kid].enter_ = counter++;
+                        stack.emplace_back(kid, 0);
+                        continue;
+                    }
+                    loops_[loop].leave_ = counter++;
+                    stack.pop_back();
+                }
+            }
+        }
+
+        std::vector<Loop> loops_;
+        // innermost loop of every block
+        std::vector<size_t> loop_of_;
+        // disjoint sets of the loops nested so far
+        std::vector<size_t> outermost_;
+    }; // class LoopForest
+
+    class Optimizer final {
+    public:
+        Optimizer(Function &function) : function_(function) {}
+
+        void Run() {
+            PropagateCopies();
+            SimplifyCFG();
+            // folded isdef tests prune paths which in turn may prove more reads defined
+            for (int round = 0; round < 2; ++round) {
+                EliminateUndefChecks();
+                NumberValues();
+                SimplifyCFG();
+            }
+            HoistLoopInvariants();
+            EliminateDeadCode();
+            SimplifyCFG();
+        }
+
+        // Forwards copies (one per assignment) and trivial phis to their sources
+        void PropagateCopies() {
+            std::vector<Instruction*> phis;
+            for (auto block : function_.GetBlocks()) {
+                for (auto inst : block->insts_) {
+                    if (inst->op_ == Opcode::Copy) {
+                        inst->ReplaceAllUsesWith(inst->operands_.front());
+                        function_.Erase(inst);
+                    } else if (inst->op_ == Opcode::Phi) {
+                        phis.push_back(inst);
+                    }
+                }
+            }
+
+            while (!phis.empty()) {
+                auto phi = phis.back();
+                phis.pop_back();
+                if (phi->erased_)
+                    continue;
+
+                auto same = GetTrivialPhiValue(*phi);
+                if (same == nullptr)
+                    continue;
+
+                for (auto [user, operand] : phi->users_) {
+                    if (user != phi && user->op_ == Opcode::Phi)
+                        phis.push_back(user);
+                }
+                phi->ReplaceAllUsesWith(same);
+                function_.Erase(phi);
+            }
+            function_.Compact();
+        }
+
+        // Folds branches on constants, drops unreachable blocks and merges
+        // straight-line block chains
+        void SimplifyCFG() {
+            for (auto block : function_.GetBlocks()) {
+                auto term = block->GetTerminator();
+                if (term == nullptr || term->op_ != Opcode::Branch || term->operands_.front()->op_ != Opcode::Const)
+                    continue;
+
+                auto taken = term->operands_.front()->imm_ ? term->targets_[0] : term->targets_[1];
+                auto dropped = term->operands_.front()->imm_ ? term->targets_[1] : term->targets_[0];
+                function_.RemoveEdge(block, dropped);
+                term->DropOperands();
+                term->op_ = Opcode::Jump;
+                term->targets_ = {taken};
+            }
+
+            DominatorTree dom_tree(function_);
+            for (auto block : function_.GetBlocks()) {
+                if (dom_tree.IsReachable(block))
+                    continue;
+                for (auto succ : block->GetSuccessors()) {
+                    if (dom_tree.IsReachable(succ))
+                        function_.RemoveEdge(block, succ);
+                }
+            }
+            for (auto block : function_.GetBlocks()) {
+                if (!dom_tree.IsReachable(block))
+                    function_.EraseBlock(block);
+            }
+
+            for (auto block : dom_tree.GetRPO()) {
+                if (block->erased_)
+                    continue;
+                for (;;) {
+                    auto term = block->GetTerminator();
+                    if (term == nullptr || term->op_ != Opcode::Jump)
+                        break;
+                    auto next = term->targets_.front();
+                    if (next->preds_.size() != 1 || next == function_.GetEntry() || next == block)
+                        break;
+                    MergeInto(block, next);
+                }
+            }
+            function_.Compact();
+        }
+
+        // A read needs its checkdef and isdef tests only if an undef may reach
+        // it through phis
+        void EliminateUndefChecks() {
+            std::unordered_set<Instruction*> maybe_undef{function_.GetUndef()};
+            std::vector<Instruction*> worklist{function_.GetUndef()};
+            while (!worklist.empty()) {
+                auto value = worklist.back();
+                worklist.pop_back();
+                for (auto [user, operand] : value->users_) {
+                    if (user->op_ == Opcode::Phi && maybe_undef.insert(user).second)
+                        worklist.push_back(user);
+                }
+            }
+
+            for (auto block : function_.GetBlocks()) {
+                for (auto inst : block->insts_) {
+                    if (inst->op_ == Opcode::CheckDef && !maybe_undef.count(inst->operands_.front()))
+                        function_.Erase(inst);
+                    if (inst->op_ == Opcode::IsDef && !maybe_undef.count(inst->operands_.front())) {
+                        inst->ReplaceAllUsesWith(function_.GetConst(1));
+                        function_.Erase(inst);
+                    }
+                }
+            }
+            function_.Compact();
+        }
+
+        // Dominator-based global value numbering with constant folding and
+        // algebraic simplification
+        void NumberValues() {
+            DominatorTree dom_tree(function_);
+            std::unordered_map<ValueKey, Instruction*, ValueKeyHash> table;
+            std::vector<std::pair<ValueKey, Instruction*>> undo;
+            std::vector<std::pair<BasicBlock*, size_t>> stack{{function_.GetEntry(), 0}};
+            std::vector<size_t> marks{0};
+
+            auto visit = [&](BasicBlock *block) {
+                for (auto inst : block->insts_) {
+                    if (auto same = Simplify(*inst)) {
+                        inst->ReplaceAllUsesWith(same);
+                        function_.Erase(inst);
+                        continue;
+                    }
+
+                    if (!IsNumbered(*inst))
+                        continue;
+
+                    auto key = MakeKey(*inst);
+                    auto [hit, inserted] = table.emplace(key, inst);
+                    if (inserted) {
+                        undo.emplace_back(key, nullptr);
+                        continue;
+                    }
+                    inst->ReplaceAllUsesWith(hit->second);
+                    function_.Erase(inst);
+                }
+            };
+
+            visit(function_.GetEntry());
+            while (!stack.empty()) {
+                auto &[block, next] = stack.back();
+                auto &kids = dom_tree.GetChildren(block);
+                if (next < kids.size()) {
+                    auto kid = kids[next++];
+                    marks.push_back(undo.size());
+                    stack.emplace_back(kid, 0);
+                    visit(kid);
+                    continue;
+                }
+
+                for (size_t mark = marks.back(); undo.size() > mark; undo.pop_back())
+                    table.erase(undo.back().first);
+                marks.pop_back();
+                stack.pop_back();
+            }
+            function_.Compact();
+        }
+
+        // Moves pure computations whose operands are defined outside of a
+        // loop into its preheader. Loops are taken from the innermost out and
+        // each one looks only at its own blocks: what was hoisted out of a
+        // nested loop sits in its preheader, a block of the loop around it,
+        // and moves on from there. Blocks of a loop without a preheader are
+        // left to the loop around it.
+        void HoistLoopInvariants() {
+            DominatorTree dom_tree(function_);
+            LoopForest forest(function_, dom_tree);
+            for (auto &loop : forest.GetLoops()) {
+                auto preheader = GetPreheader(forest, loop);
+                if (preheader == nullptr) {
+                    if (loop.parent_ != Loop::NONE) {
+                        auto &outer = forest.GetLoops()[loop.parent_].blocks_;
+                        auto middle = outer.insert(outer.end(), loop.blocks_.begin(), loop.blocks_.end());
+                        std::inplace_merge(outer.begin(), middle, outer.end(), [&dom_tree](auto lhs, auto rhs) {
+                            return dom_tree.GetRPOIndex(lhs) < dom_tree.GetRPOIndex(rhs);
+                        });
+                    }
+                    continue;
+                }
+
+                std::vector<Instruction*> hoisted;
+                for (auto block : loop.blocks_) {
+                    std::vector<Instruction*> kept;
+                    for (auto inst : block->insts_) {
+                        if (!IsHoistable(forest, *inst, loop)) {
+                            kept.push_back(inst);
+                            continue;
+                        }
+                        hoisted.push_back(inst);
+                        inst->parent_ = preheader;
+                    }
+                    block->insts_ = std::move(kept);
+                }
+                preheader->insts_.insert(preheader->insts_.end() - 1, hoisted.begin(), hoisted.end());
+            }
+        }
+
+        // Removes every computation that does not contribute to an effect,
+        // this includes assignments which are never read
+        void EliminateDeadCode() {
+            std::unordered_set<Instruction*> live;
+            std::vector<Instruction*> worklist;
+            for (auto block : function_.GetBlocks()) {
+                for (auto inst : block->insts_) {
+                    if (inst->HasSideEffects() && live.insert(inst).second)
+                        worklist.push_back(inst);
+                }
+            }
+
+            while (!worklist.empty()) {
+                auto inst = worklist.back();
+                worklist.pop_back();
+                for (auto operand : inst->operands_) {
+                    if (live.insert(operand).second)
+                        worklist.push_back(operand);
+                }
+            }
+
+            for (auto block : function_.GetBlocks()) {
+                for (auto inst : block->insts_) {
+                    if (!live.count(inst))
+                        function_.Erase(inst);
+                }
+            }
+            function_.Compact();
+        }
+
+    private:
+        struct ValueKey final {
+            Opcode op_;
+            size_t lhs_;
+            size_t rhs_;
+
+            bool operator==(const ValueKey &other) const {
+                return op_ == other.op_ && lhs_ == other.lhs_ && rhs_ == other.rhs_;
+            }
+        }; // struct ValueKey
+
+        struct ValueKeyHash final {
+            size_t operator()(const ValueKey &key) const {
+                size_t hash = std::hash<size_t>{}(key.lhs_);
+                hash = hash * 31 + std::hash<size_t>{}(key.rhs_);
+                return hash * 31 + size_t(key.op_);
+            }
+        }; // struct ValueKeyHash
+
+        static bool IsNumbered(const Instruction &inst) {
+            return IsUnary(inst.op_) || IsBinary(inst.op_) || inst.op_ == Opcode::IsDef || inst.op_ == Opcode::CheckDef;
+        }
+
+        static ValueKey MakeKey(const Instruction &inst) {
+            size_t lhs = inst.operands_[0]->id_;
+            size_t rhs = inst.operands_.size() > 1 ? inst.operands_[1]->id_ : 0;
+            if (IsCommutative(inst.op_) && lhs > rhs)
+                std::swap(lhs, rhs);
+            return {inst.op_, lhs, rhs};
+        }
+
+        static Instruction *GetTrivialPhiValue(const Instruction &phi) {
+            Instruction *same = nullptr;
+            for (auto operand : phi.operands_) {
+                if (operand == same || operand == &phi)
+                    continue;
+                if (same != nullptr)
+                    return nullptr;
+                same = operand;
+            }
+            return same;
+        }
+
+        // Returns an existing value equal to inst or nullptr
+        Instruction *Simplify(const Instruction &inst) {
+            if (inst.op_ == Opcode::Phi)
+                return GetTrivialPhiValue(inst);
+
+            if (inst.op_ == Opcode::IsDef && inst.operands_[0]->IsConstant())
+                return function_.GetConst(inst.operands_[0]->op_ == Opcode::Const);
+
+            if (!IsUnary(inst.op_) && !IsBinary(inst.op_))
+                return nullptr;
+
+            auto lhs = inst.operands_[0];
+            auto rhs = IsBinary(inst.op_) ? inst.operands_[1] : nullptr;
+            auto is_const = [](const Instruction *value, int imm) {
+                return value->op_ == Opcode::Const && value->imm_ == imm;
+            };
+
+            if (lhs->op_ == Opcode::Const && (rhs == nullptr || rhs->op_ == Opcode::Const)) {
+                if ((inst.op_ == Opcode::Div || inst.op_ == Opcode::Rem) && rhs->imm_ == 0)
+                    return nullptr;
+                return function_.GetConst(Evaluate(inst.op_, lhs->imm_, rhs ? rhs->imm_ : 0));
+            }
+
+            switch (inst.op_) {
+                case Opcode::Neg:
+                    return lhs->op_ == Opcode::Neg ? lhs->operands_[0] : nullptr;
+                case Opcode::Add:
+                    if (is_const(rhs, 0)) return lhs;
+                    if (is_const(lhs, 0)) return rhs;
+                    return nullptr;
+                case Opcode::Sub:
+                    if (is_const(rhs, 0)) return lhs;
+                    if (lhs == rhs) return function_.GetConst(0);
+                    return nullptr;
+                case Opcode::Mul:
+                    if (is_const(rhs, 1)) return lhs;
+                    if (is_const(lhs, 1)) return rhs;
+                    if (is_const(rhs, 0) || is_const(lhs, 0)) return function_.GetConst(0);
+                    return nullptr;
+                case Opcode::Div:
+                    return is_const(rhs, 1) ? lhs : nullptr;
+                case Opcode::Rem:
+                    return is_const(rhs, 1) ? function_.GetConst(0) : nullptr;
+                case Opcode::Eq:
+                case Opcode::Ge:
+                case Opcode::Le:
+                    return lhs == rhs ? function_.GetConst(1) : nullptr;
+                case Opcode::Ne:
+                case Opcode::Gt:
+                case Opcode::Lt:
+                    return lhs == rhs ? function_.GetConst(0) : nullptr;
+                default:
+                    return nullptr;
+            }
+        }
+
+        static BasicBlock *GetPreheader(const LoopForest &forest, const Loop &loop) {
+            BasicBlock *preheader = nullptr;
+            for (auto pred : loop.header_->preds_) {
+                if (forest.Contains(loop, pred))
+                    continue;
+                if (preheader != nullptr)
+                    return nullptr;
+                preheader = pred;
+            }
+
+            if (preheader == nullptr || preheader->GetSuccessors().size() != 1)
+                return nullptr;
+            return preheader;
+        }
+
+        static bool IsHoistable(const LoopForest &forest, const Instruction &inst, const Loop &loop) {
+            if (!IsUnary(inst.op_) && !IsBinary(inst.op_) && inst.op_ != Opcode::IsDef)
+                return false;
+            if (inst.MayTrap())
+                return false;
+            return std::all_of(inst.operands_.begin(), inst.operands_.end(), [&](const Instruction *operand) {
+                return !forest.Contains(loop, operand->parent_);
+            });
+        }
+
+        // Appends next to block; next must be the single successor of block
+        // and have block as its single predecessor
+        void MergeInto(BasicBlock *block, BasicBlock *next) {
+            for (size_t i = 0, phis = next->GetPhiCount(); i < phis; ++i) {
+                auto phi = next->insts_[i];
+                phi->ReplaceAllUsesWith(phi->operands_.front());
+                function_.Erase(phi);
+            }
+
+            auto term = block->GetTerminator();
+            function_.Erase(term);
+            block->insts_.pop_back();
+
+            for (auto inst : next->insts_) {
+                if (inst->erased_)
+                    continue;
+                inst->parent_ = block;
+                block->insts_.push_back(inst);
+            }
+            next->insts_.clear();
+
+            for (auto succ : block->GetSuccessors())
+                std::replace(succ->preds_.begin(), succ->preds_.end(), next, block);
+            next->preds_.clear();
+            next->erased_ = true;
+        }
+
+        Function &function_;
+    }; // class Optimizer
+} // namespace ir
@@ -8,12 +8,7 @@
 
 namespace yy {
     class Lexer final : public yyFlexLexer {
-        Lexer(const std::string_view file_name) : yyFlexLexer(), loc_(file_name) {}
     public:
-        static Lexer &QueryLexer(const std::string_view file_name) {
-            static Lexer lexer{file_name};
-            return lexer;
-        }
         int yylex() override;
 
         // here we can return non-zero if lexing is not done inspite of EOF detected
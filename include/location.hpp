@@ -1,5 +1,4 @@
 #pragma once
-#include <fstream>
 
 namespace yy {
     struct Location final {
@@ -9,20 +8,6 @@ namespace yy {
         }; // struct Position
         
     public:
-        Location() {}
-        Location(const std::string_view file_name) {
-            std::ifstream file(file_name.data());
-            if (!file.is_open()) {
-                throw std::invalid_argument("Can't open file");
-            }
-
-            std::string line;
-            while (std::getline(file, line))
-                code_lines_.push_back(line);
-        
-            file.close();
-        }
-
         void Step() {
             begin = end;
         }
@@ -34,14 +19,8 @@ namespace yy {
         void Lines(int count = 1) {
             end.line += count;
         }
-        
-        const std::string &GetCodeLine(size_t line_num) const {
-            return code_lines_[line_num];
-        }
 
         Position begin;
         Position end;
-    private:
-        inline static std::vector<std::string> code_lines_{};
     }; // class Location
 };
\ No newline at end of file
@@ -0,0 +1,128 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#include "interner.hpp"
+
+namespace resolver {
+    // Static model of the executer's name binding for code generators.
+    // Every scope owns a slot per name assigned in it. At run time a name
+    // refers to the innermost slot that has been assigned, otherwise an
+    // assignment declares it in the current scope. The resolver tracks which
+    // slots are definitely assigned at the current point of a walk in
+    // program order, so backends resolve most names statically and emit
+    // run-time tests only for slots that may be unassigned.
+    class NameResolver final {
+    public:
+        void PushScope() {
+            scopes_.emplace_back();
+            scope_ids_.push_back(scope_count_++);
+        }
+
+        // Returns slots owned by the scope being left
+        std::vector<size_t> PopScope() {
+            std::vector<size_t> slots;
+            for (auto [name, slot] : scopes_.back()) {
+                slots.push_back(slot);
+                auto bound = bindings_.find(name);
+                bound->second.pop_back();
+                if (bound->second.empty())
+                    bindings_.erase(bound);
+            }
+            scopes_.pop_back();
+            scope_ids_.pop_back();
+            return slots;
+        }
+
+        size_t GetCurrentScopeId() const {
+            return scope_ids_.back();
+        }
+
+        size_t GetSlotScopeId(size_t slot) const {
+            return slot_scopes_[slot];
+        }
+
+        // Slots the name may be bound to, innermost first, up to the first
+        // one that is definitely assigned
+        std::vector<size_t> GetCandidateSlots(intern::Atom name) const {
+            std::vector<size_t> slots;
+            auto bound = bindings_.find(name);
+            if (bound == bindings_.end())
+                return slots;
+            for (auto it = bound->second.rbegin(), end = bound->second.rend(); it != end; ++it) {
+                slots.push_back(*it);
+                if (definite_[*it])
+                    break;
+            }
+            return slots;
+        }
+
+        // True if an assignment to name can store straight into the first
+        // candidate slot without run-time tests
+        bool IsStaticStore(intern::Atom name, const std::vector<size_t> &slots) const {
+            if (slots.empty() || definite_[slots.front()])
+                return true;
+            auto local = scopes_.back().find(name);
+            return slots.size() == 1 && local != scopes_.back().end() && local->second == slots.front();
+        }
+
+        size_t GetLocalSlot(intern::Atom name) {
+            auto [hit, inserted] = scopes_.back().emplace(name, definite_.size());
+            if (inserted) {
+                bindings_[name].push_back(hit->second);
+                definite_.push_back(false);
+                slot_scopes_.push_back(scope_ids_.back());
+            }
+            return hit->second;
+        }
+
+        bool IsDefinite(size_t slot) const {
+            return definite_[slot];
+        }
+
+        void SetDefinite(size_t slot) {
+            if (definite_[slot])
+                return;
+            definite_[slot] = true;
+            log_.push_back(slot);
+        }
+
+        size_t Mark() const {
+            return log_.size();
+        }
+
+        // Forgets the slots marked definite since mark and returns them
+        std::vector<size_t> Undo(size_t mark) {
+            std::vector<size_t> slots(log_.begin() + mark, log_.end());
+            for (auto slot : slots)
+                definite_[slot] = false;
+            log_.resize(mark);
+            return slots;
+        }
+
+        // Marks slots assigned on both of two alternative paths as definite
+        void Join(const std::vector<size_t> &lhs, const std::vector<size_t> &rhs) {
+            std::vector<size_t> both;
+            for (auto slot : rhs)
+                definite_[slot] = true;
+            std::copy_if(lhs.begin(), lhs.end(), std::back_inserter(both), [this](size_t slot) { return definite_[slot]; });
+            for (auto slot : rhs)
+                definite_[slot] = false;
+            for (auto slot : both)
+                SetDefinite(slot);
+        }
+
+    private:
+        std::vector<std::unordered_map<intern::Atom, size_t>> scopes_;
+        // slots of every name, outermost first, so a lookup does not go
+        // through the scopes that do not bind the name
+        std::unordered_map<intern::Atom, std::vector<size_t>> bindings_;
+        std::vector<size_t> scope_ids_;
+        size_t scope_count_ = 0;
+
+        std::vector<bool> definite_;
+        std::vector<size_t> slot_scopes_;
+        std::vector<size_t> log_;
+    }; // class NameResolver
+} // namespace resolver
@@ -0,0 +1,91 @@
+#pragma once
+#include <string>
+#include <stdexcept>
+
+#include "error_handler.hpp"
+#include "node.hpp"
+
+namespace nesting {
+    // Rejects trees nested deeper than the limit, reporting the first node
+    // beyond it. Every pass over the AST walks it on the heap, so the limit
+    // only bounds the memory a program may take, not the call stack.
+    class NestingVisitor final : public node::WalkVisitor {
+    public:
+        NestingVisitor(const err::ErrorHandler &err_handler, size_t max_depth) :
+            err_handler_(err_handler), max_depth_(max_depth) {}
+
+        void Check(node::Node &root) {
+            Walk(root);
+        }
+
+        void Visit(node::LogicOpNode &node) override {
+            CheckNode(node, { node.left_, node.right_ });
+        }
+
+        void Visit(node::UnOpNode &node) override {
+            CheckNode(node, { node.child_ });
+        }
+
+        void Visit(node::BinOpNode &node) override {
+            CheckNode(node, { node.left_, node.right_ });
+        }
+
+        void Visit(node::BinCompOpNode &node) override {
+            CheckNode(node, { node.left_, node.right_ });
+        }
+
+        void Visit(node::NumberNode &node) override {
+            CheckNode(node, {});
+        }
+
+        void Visit(node::InputNode &node) override {
+            CheckNode(node, {});
+        }
+
+        void Visit(node::VarNode &node) override {
+            CheckNode(node, {});
+        }
+
+        void Visit(node::ScopeNode &node) override {
+            CheckNode(node, node.kids_);
+        }
+
+        void Visit(node::DeclNode &node) override {
+            CheckNode(node, {});
+        }
+
+        void Visit(node::CondNode &node) override {
+            CheckNode(node, { node.predicat_, node.first_, node.second_ });
+        }
+
+        void Visit(node::LoopNode &node) override {
+            CheckNode(node, { node.predicat_, node.scope_ });
+        }
+
+        void Visit(node::AssignNode &node) override {
+            CheckNode(node, { node.var_, node.expr_ });
+        }
+
+        void Visit(node::OutputNode &node) override {
+            CheckNode(node, { node.expr_ });
+        }
+
+    private:
+        void CheckNode(const node::Node &node, std::initializer_list<node::Node*> kids) {
+            CheckNode<std::initializer_list<node::Node*>>(node, kids);
+        }
+
+        template <typename Kids>
+        void CheckNode(const node::Node &node, const Kids &kids) {
+            if (GetStep() == 0 && GetDepth() > max_depth_) {
+                throw std::logic_error(err_handler_.GetFullErrorMessage("Syntax error", \
+                                        "nesting is deeper than " + std::to_string(max_depth_) + " levels", \
+                                        node.location_));
+            }
+            DescendNext(kids);
+        }
+
+        const err::ErrorHandler &err_handler_;
+        size_t max_depth_;
+    }; // class NestingVisitor
+} // namespace nesting
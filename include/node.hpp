@@ -2,7 +2,10 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <initializer_list>
+#include <cassert>
 #include "location.hpp"
+#include "interner.hpp"
 
 namespace node {
     namespace details {
@@ -51,14 +54,19 @@ namespace node {
 
     struct Node {
     public:
-        Node(yy::Location location) : location_(location) {}
+        Node(yy::Location location, bool leaf = false) : location_(location), leaf_(leaf) {}
         virtual ~Node() = default;
         virtual void Accept(NodeVisitor &visitor) = 0;
+        // A leaf has no kids and its value is at hand, so visiting it
+        // never descends nor suspends a walk
+        bool IsLeaf() const { return leaf_; }
         yy::Location location_;
+    private:
+        bool leaf_;
     }; // class Node
 
     struct ExprNode : public Node {
-        ExprNode(yy::Location location) : Node(location) {}
+        ExprNode(yy::Location location, bool leaf = false) : Node(location, leaf) {}
         void Accept(NodeVisitor &visitor) override = 0;
     }; // class ExprNode
 
@@ -70,9 +78,9 @@ namespace node {
     }; // class ScopeNode
 
     struct DeclNode final : public Node {
-        DeclNode(const std::string &name, yy::Location location) : Node(location), name_(std::move(name)) {}
+        DeclNode(intern::Atom name, yy::Location location) : Node(location), name_(name) {}
         void Accept(NodeVisitor &visitor) override;
-        std::string name_;
+        intern::Atom name_;
     }; // class DeclNode
 
     struct CondNode final : public Node {
@@ -131,20 +139,22 @@ namespace node {
     }; // class BinCompOpNode
 
     struct NumberNode final : public ExprNode {
-        NumberNode(int number, yy::Location location) : ExprNode(location), number_(number) {}
+        NumberNode(int number, yy::Location location) : ExprNode(location, true), number_(number) {}
         void Accept(NodeVisitor &visitor) override;
         int number_;
     }; // class NumberNode
 
+    // Not a leaf, though it has no kids: reading may have to wait for the
+    // input, and only a node with a frame of its own can suspend a walk
     struct InputNode final : public ExprNode {
         InputNode(yy::Location location) : ExprNode(location) {}
         void Accept(NodeVisitor &visitor) override;
     }; // class InputNode
 
     struct VarNode final : public ExprNode {
-        VarNode(const std::string &name, yy::Location location) : ExprNode(location), name_(std::move(name)) {}
+        VarNode(intern::Atom name, yy::Location location) : ExprNode(location, true), name_(name) {}
         void Accept(NodeVisitor &visitor) override;
-        std::string name_;
+        intern::Atom name_;
     }; // class VarNode
 
     struct AssignNode final : public ExprNode {
@@ -172,6 +182,108 @@ namespace node {
         virtual void Visit(OutputNode &node) = 0;
     }; // class NodeVisitor
 
+    // Base of visitors that walk the tree with a stack of frames on the heap
+    // instead of the call stack, so any depth fits as long as memory does.
+    // A Visit method either schedules one kid with Descend and returns, to be
+    // called again for the same node once the kid is done, or returns without
+    // descending, which finishes the node. GetStep() is zero on the first
+    // call for a node and then the step passed to the last Descend.
+    // The whole state of a walk is in the frames, so a walk can be stopped
+    // after any visit and resumed later, also on another thread.
+    class WalkVisitor : public NodeVisitor {
+    protected:
+        // Walks the whole tree, no Visit may suspend it
+        void Walk(Node &root) {
+            Start(root);
+            while (!frames_.empty()) {
+                auto size = frames_.size();
+                frames_.back().node->Accept(*this);
+                assert(!suspended_);
+                if (frames_.size() == size)
+                    frames_.pop_back();
+            }
+        }
+
+        void Start(Node &root) {
+            frames_.clear();
+            frames_.push_back({ &root, 0 });
+        }
+
+        // Visits at most max_steps nodes. Returns true once the whole tree
+        // is walked, false if the steps ran out or a Visit suspended the walk.
+        bool Resume(size_t max_steps) {
+            suspended_ = false;
+            for (; max_steps != 0 && !frames_.empty(); --max_steps) {
+                auto size = frames_.size();
+                frames_.back().node->Accept(*this);
+                if (suspended_)
+                    return false;
+                if (frames_.size() == size)
+                    frames_.pop_back();
+            }
+            return frames_.empty();
+        }
+
+        // Stops the walk, the node is visited again with the same step when
+        // it resumes. Must be the last thing a Visit method does.
+        void Suspend() {
+            suspended_ = true;
+        }
+
+        bool IsSuspended() const {
+            return suspended_;
+        }
+
+        size_t GetStep() const {
+            return frames_.back().step;
+        }
+
+        // Moves the current node on to a later step, for a Visit that did
+        // the work of the steps in between itself
+        void SetStep(size_t step) {
+            frames_.back().step = step;
+        }
+
+        // Must be the last thing a Visit method does
+        void Descend(Node &kid, size_t next_step) {
+            frames_.back().step = next_step;
+            frames_.push_back({ &kid, 0 });
+        }
+
+        // Descends into the first kid that is not null starting from the one
+        // the step points to, the step being the index of the next kid.
+        // Returns false once all kids are done.
+        template <typename Kids>
+        bool DescendNext(const Kids &kids) {
+            for (auto step = GetStep(); step < kids.size(); ++step) {
+                auto kid = kids.begin()[step];
+                if (kid != nullptr) {
+                    Descend(*kid, step + 1);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool DescendNext(std::initializer_list<Node*> kids) {
+            return DescendNext<std::initializer_list<Node*>>(kids);
+        }
+
+        // Number of nodes on the path from the root to the current one
+        size_t GetDepth() const {
+            return frames_.size();
+        }
+
+    private:
+        struct Frame final {
+            Node *node;
+            size_t step;
+        }; // struct Frame
+
+        std::vector<Frame> frames_;
+        bool suspended_ = false;
+    }; // class WalkVisitor
+
     inline void LogicOpNode::Accept(NodeVisitor &visitor) {
         visitor.Visit(*this);
     }
@@ -0,0 +1,399 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <numeric>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cassert>
+
+#include "interner.hpp"
+#include "node.hpp"
+#include "induction.hpp"
+
+namespace parallel {
+    // Scopes nested deeper than this are not split. Every statement is
+    // summarized once for each of the scopes around it that is split, so the
+    // limit keeps the analysis linear in the size of the program.
+    constexpr size_t MAX_DEPTH = 16;
+
+    // Statements of a scope that may run at the same time on other threads.
+    // A task is a list of statements in program order; no task reads or
+    // assigns a variable another one assigns, and no task reads input.
+    // Every task but one holds a loop, the statements without loops are all
+    // gathered in one task.
+    struct Batch final {
+        struct Task final {
+            // indices into the kids of the scope
+            std::vector<size_t> statements;
+            // variables the task reads or assigns
+            std::vector<intern::Atom> names;
+            // variables the task assigns
+            std::vector<intern::Atom> assigned;
+        }; // struct Task
+
+        // number of statements from the first one on
+        size_t count = 0;
+        std::vector<Task> tasks;
+    }; // struct Batch
+
+    namespace details {
+        // What running a statement touches outside of it
+        struct Access final {
+            std::vector<intern::Atom> read;
+            std::vector<intern::Atom> assigned;
+            bool input = false;
+            // holds a loop that may take long, one with a closed form does not
+            bool loop = false;
+        }; // struct Access
+
+        inline void SortUnique(std::vector<intern::Atom> &names) {
+            std::sort(names.begin(), names.end());
+            names.erase(std::unique(names.begin(), names.end()), names.end());
+        }
+
+        class AccessVisitor final : public node::WalkVisitor {
+        public:
+            AccessVisitor(const induction::Analysis *loops) : loops_(loops) {}
+
+            Access Collect(node::Node &statement) {
+                access_ = {};
+                Walk(statement);
+                SortUnique(access_.read);
+                SortUnique(access_.assigned);
+                return std::move(access_);
+            }
+
+            void Visit(node::LogicOpNode &node) override {
+                DescendNext({ node.left_, node.right_ });
+            }
+
+            void Visit(node::UnOpNode &node) override {
+                DescendNext({ node.child_ });
+            }
+
+            void Visit(node::BinOpNode &node) override {
+                DescendNext({ node.left_, node.right_ });
+            }
+
+            void Visit(node::BinCompOpNode &node) override {
+                DescendNext({ node.left_, node.right_ });
+            }
+
+            void Visit(node::NumberNode &node) override {}
+
+            void Visit(node::InputNode &node) override {
+                access_.input = true;
+            }
+
+            void Visit(node::VarNode &node) override {
+                access_.read.push_back(node.name_);
+            }
+
+            void Visit(node::ScopeNode &node) override {
+                DescendNext(node.kids_);
+            }
+
+            void Visit(node::DeclNode &node) override {}
+
+            void Visit(node::CondNode &node) override {
+                DescendNext({ node.predicat_, node.first_, node.second_ });
+            }
+
+            void Visit(node::LoopNode &node) override {
+                if (GetStep() == 0 && (loops_ == nullptr || loops_->Find(node) == nullptr))
+                    access_.loop = true;
+                DescendNext({ node.predicat_, node.scope_ });
+            }
+
+            void Visit(node::AssignNode &node) override {
+                if (GetStep() == 0)
+                    access_.assigned.push_back(node.var_->name_);
+                DescendNext({ node.expr_ });
+            }
+
+            void Visit(node::OutputNode &node) override {
+                DescendNext({ node.expr_ });
+            }
+
+        private:
+            const induction::Analysis *loops_;
+            Access access_;
+        }; // class AccessVisitor
+
+        // Components of statements that share a variable someone assigns
+        class DisjointSets final {
+        public:
+            DisjointSets(size_t size) : parents_(size) {
+                std::iota(parents_.begin(), parents_.end(), 0);
+            }
+
+            size_t Find(size_t element) {
+                while (parents_[element] != element)
+                    element = parents_[element] = parents_[parents_[element]];
+                return element;
+            }
+
+            void Unite(size_t lhs, size_t rhs) {
+                parents_[Find(lhs)] = Find(rhs);
+            }
+
+        private:
+            std::vector<size_t> parents_;
+        }; // class DisjointSets
+    } // namespace details
+
+    // Splits scopes into batches. Statements that read input stay in order
+    // and end a batch, the statements between them go to tasks by the
+    // variables they share. print is no obstacle: the output of a batch is
+    // put together in program order after the run.
+    class Analysis final {
+    public:
+        void Analyze(node::Node &root, const induction::Analysis *loops) {
+            batches_.clear();
+            FindVisitor(*this, loops).Find(root);
+        }
+
+        // The batch that starts with the statement
+        const Batch *Find(const node::Node &statement) const {
+            auto it = batches_.find(&statement);
+            return it == batches_.end() ? nullptr : &it->second;
+        }
+
+    private:
+        // Only statements hold scopes, expressions are not entered
+        class FindVisitor final : public node::WalkVisitor {
+        public:
+            FindVisitor(Analysis &analysis, const induction::Analysis *loops) : analysis_(analysis), access_(loops) {}
+
+            void Find(node::Node &root) {
+                depth_ = 0;
+                Walk(root);
+            }
+
+            void Visit(node::LogicOpNode &node) override {}
+            void Visit(node::UnOpNode &node) override {}
+            void Visit(node::BinOpNode &node) override {}
+            void Visit(node::BinCompOpNode &node) override {}
+            void Visit(node::NumberNode &node) override {}
+            void Visit(node::InputNode &node) override {}
+            void Visit(node::VarNode &node) override {}
+
+            void Visit(node::ScopeNode &node) override {
+                if (GetStep() == 0) {
+                    if (++depth_ > MAX_DEPTH) {
+                        --depth_;
+                        return;
+                    }
+                    Split(node);
+                }
+                if (!DescendNext(node.kids_))
+                    --depth_;
+            }
+
+            void Visit(node::DeclNode &node) override {}
+
+            void Visit(node::CondNode &node) override {
+                DescendNext({ node.first_, node.second_ });
+            }
+
+            void Visit(node::LoopNode &node) override {
+                DescendNext({ node.scope_ });
+            }
+
+            void Visit(node::AssignNode &node) override {}
+            void Visit(node::OutputNode &node) override {}
+
+        private:
+            // Variables of a window: the statement that last assigned one,
+            // or the statements that read it while nobody assigned it yet
+            struct Owner final {
+                size_t assigner = 0;
+                bool assigned = false;
+                std::vector<size_t> readers;
+            }; // struct Owner
+
+            // Goes through the statements in order and gathers them in a
+            // window until one would tie two tasks with loops together, as a
+            // print of what both computed does. A window of two tasks with
+            // loops at least is a batch. A window opens at a loop, the
+            // statements before it run in order: they are usually what the
+            // loops start from.
+            void Split(node::ScopeNode &node) {
+                auto size = node.kids_.size();
+                if (size < 2)
+                    return;
+                std::vector<details::Access> accesses;
+                accesses.reserve(size);
+                for (auto kid : node.kids_)
+                    accesses.push_back(access_.Collect(*kid));
+
+                details::DisjointSets sets(size);
+                // whether the set of the root holds a loop
+                std::vector<bool> loops(size);
+                std::unordered_map<intern::Atom, Owner> owners;
+                auto begin = size;
+                for (size_t i = 0; i <= size; ++i) {
+                    bool close = i == size || accesses[i].input;
+                    std::vector<size_t> links;
+                    if (!close && begin != size) {
+                        links = Links(sets, owners, accesses[i]);
+                        close = std::count_if(links.begin(), links.end(), [&loops](auto root) { return loops[root]; }) >= 2;
+                    }
+                    if (close && begin != size) {
+                        Plan(node, accesses, sets, loops, begin, i);
+                        begin = size;
+                        owners.clear();
+                        links.clear();
+                    }
+                    if (i == size || accesses[i].input || (begin == size && !accesses[i].loop))
+                        continue;
+
+                    if (begin == size)
+                        begin = i;
+                    bool loop = accesses[i].loop;
+                    for (auto root : links) {
+                        loop = loop || loops[root];
+                        sets.Unite(root, i);
+                    }
+                    loops[sets.Find(i)] = loop;
+                    Record(owners, accesses[i], i);
+                }
+            }
+
+            // Sets of the window a statement depends on or that depend on it
+            static std::vector<size_t> Links(details::DisjointSets &sets, const std::unordered_map<intern::Atom, Owner> &owners,
+                                             const details::Access &access) {
+                std::vector<size_t> links;
+                for (auto name : access.assigned) {
+                    auto it = owners.find(name);
+                    if (it == owners.end())
+                        continue;
+                    if (it->second.assigned)
+                        links.push_back(sets.Find(it->second.assigner));
+                    for (auto reader : it->second.readers)
+                        links.push_back(sets.Find(reader));
+                }
+                for (auto name : access.read) {
+                    auto it = owners.find(name);
+                    if (it != owners.end() && it->second.assigned)
+                        links.push_back(sets.Find(it->second.assigner));
+                }
+                std::sort(links.begin(), links.end());
+                links.erase(std::unique(links.begin(), links.end()), links.end());
+                return links;
+            }
+
+            // Called once the statement is in the set of everyone it touches
+            static void Record(std::unordered_map<intern::Atom, Owner> &owners, const details::Access &access, size_t statement) {
+                for (auto name : access.assigned) {
+                    auto &owner = owners[name];
+                    owner.assigner = statement;
+                    owner.assigned = true;
+                    owner.readers.clear();
+                }
+                for (auto name : access.read) {
+                    auto &owner = owners[name];
+                    if (!owner.assigned)
+                        owner.readers.push_back(statement);
+                }
+            }
+
+            // Every set with a loop is a task, the rest is the last one
+            void Plan(node::ScopeNode &node, const std::vector<details::Access> &accesses, details::DisjointSets &sets,
+                      const std::vector<bool> &loops, size_t begin, size_t end) {
+                std::unordered_map<size_t, size_t> task_of;
+                for (size_t i = begin; i < end; ++i) {
+                    auto root = sets.Find(i);
+                    if (loops[root])
+                        task_of.try_emplace(root, task_of.size());
+                }
+                if (task_of.size() < 2)
+                    return;
+
+                std::vector<Batch::Task> tasks(task_of.size() + 1);
+                for (size_t i = begin; i < end; ++i) {
+                    auto it = task_of.find(sets.Find(i));
+                    auto &task = it == task_of.end() ? tasks.back() : tasks[it->second];
+                    task.statements.push_back(i);
+                    task.assigned.insert(task.assigned.end(), accesses[i].assigned.begin(), accesses[i].assigned.end());
+                    task.names.insert(task.names.end(), accesses[i].assigned.begin(), accesses[i].assigned.end());
+                    task.names.insert(task.names.end(), accesses[i].read.begin(), accesses[i].read.end());
+                }
+                if (tasks.back().statements.empty())
+                    tasks.pop_back();
+                for (auto &task : tasks) {
+                    details::SortUnique(task.assigned);
+                    details::SortUnique(task.names);
+                }
+
+                auto &batch = analysis_.batches_[node.kids_[begin]];
+                batch.count = end - begin;
+                batch.tasks = std::move(tasks);
+            }
+
+            Analysis &analysis_;
+            details::AccessVisitor access_;
+            size_t depth_ = 0;
+        }; // class FindVisitor
+
+        std::unordered_map<const node::Node*, Batch> batches_;
+    }; // class Analysis
+
+    // Threads that run the tasks of batches. They are started on the first
+    // task, so programs without batches start none.
+    class Pool final {
+    public:
+        Pool(size_t threads) : size_(std::max<size_t>(threads, 1)) {}
+
+        Pool(const Pool&) = delete;
+        Pool &operator=(const Pool&) = delete;
+
+        ~Pool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopped_ = true;
+            }
+            ready_.notify_all();
+            for (auto &thread : threads_)
+                thread.join();
+        }
+
+        void Submit(std::function<void()> task) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (threads_.empty()) {
+                    for (size_t i = 0; i < size_; ++i)
+                        threads_.emplace_back([this] { Work(); });
+                }
+                queue_.push_back(std::move(task));
+            }
+            ready_.notify_one();
+        }
+
+    private:
+        void Work() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            for (;;) {
+                ready_.wait(lock, [this] { return stopped_ || !queue_.empty(); });
+                if (queue_.empty())
+                    return;
+                auto task = std::move(queue_.front());
+                queue_.pop_front();
+                lock.unlock();
+                task();
+                lock.lock();
+            }
+        }
+
+        size_t size_;
+        std::vector<std::thread> threads_;
+        std::mutex mutex_;
+        std::condition_variable ready_;
+        std::deque<std::function<void()>> queue_;
+        bool stopped_ = false;
+    }; // class Pool
+} // namespace parallel
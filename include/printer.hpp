@@ -0,0 +1,317 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <ostream>
+#include <limits>
+#include <cassert>
+
+#include "interner.hpp"
+#include "node.hpp"
+#include "drawer.hpp"
+
+namespace printer {
+    // Writes an AST back as ParaCL source that parses into the same tree.
+    // Every operation below the top of an expression is parenthesized, so
+    // no precedence is ever in doubt, and an if without else that would otherwise take the else of an outer
+    // if gets an empty else of its own. The root scope is the program
+    // itself and gets no braces.
+    class PrintVisitor final : public node::WalkVisitor {
+    public:
+        PrintVisitor(std::ostream &out, const intern::Interner &interner) : out_(out), interner_(interner) {}
+
+        void Print(node::Node &root) {
+            contexts_.clear();
+            outdents_.clear();
+            next_ = {};
+            indent_ = 0;
+            Walk(root);
+        }
+
+        void Visit(node::LogicOpNode &node) override {
+            assert(node.left_ && node.right_);
+            PrintOperation(node, drawer::OpTexts.at(node.type_));
+        }
+
+        void Visit(node::UnOpNode &node) override {
+            assert(node.child_);
+            switch (GetStep()) {
+                case 0:
+                    Enter();
+                    Open();
+                    out_ << drawer::OpTexts.at(node.type_);
+                    DescendExpression(*node.child_, 1);
+                    return;
+                default:
+                    Close();
+                    Leave();
+                    return;
+            }
+        }
+
+        void Visit(node::BinOpNode &node) override {
+            assert(node.left_ && node.right_);
+            PrintOperation(node, drawer::OpTexts.at(node.type_));
+        }
+
+        void Visit(node::BinCompOpNode &node) override {
+            assert(node.left_ && node.right_);
+            PrintOperation(node, drawer::OpTexts.at(node.type_));
+        }
+
+        void Visit(node::NumberNode &node) override {
+            Enter();
+            // a literal has no sign and the smallest int has no positive twin
+            if (node.number_ == std::numeric_limits<int>::min()) {
+                Open();
+                out_ << "-" << std::numeric_limits<int>::max() << " - 1";
+                Close();
+            } else if (node.number_ < 0) {
+                Open();
+                out_ << "-" << -node.number_;
+                Close();
+            } else {
+                out_ << node.number_;
+            }
+            Leave();
+        }
+
+        void Visit(node::InputNode &node) override {
+            Enter();
+            out_ << "?";
+            Leave();
+        }
+
+        void Visit(node::VarNode &node) override {
+            Enter();
+            out_ << interner_.GetName(node.name_);
+            Leave();
+        }
+
+        void Visit(node::ScopeNode &node) override {
+            if (GetStep() == 0) {
+                bool root = contexts_.empty();
+                Enter();
+                if (!root) {
+                    if (!contexts_.back().branch)
+                        Indent();
+                    out_ << "{\n";
+                    ++indent_;
+                }
+            }
+
+            auto step = GetStep();
+            if (step < node.kids_.size()) {
+                assert(node.kids_[step]);
+                DescendStatement(*node.kids_[step], step + 1, false);
+                return;
+            }
+
+            if (contexts_.size() != 1) {
+                --indent_;
+                Indent();
+                out_ << (contexts_.back().branch ? "}" : "}\n");
+            }
+            Leave();
+        }
+
+        void Visit(node::DeclNode &node) override {
+            Enter();
+            out_ << interner_.GetName(node.name_);
+            Leave();
+        }
+
+        void Visit(node::CondNode &node) override {
+            assert(node.predicat_ && node.first_);
+            switch (GetStep()) {
+                case 0:
+                    Enter();
+                    Indent();
+                    out_ << "if (";
+                    DescendExpression(*node.predicat_, 1, true);
+                    return;
+                case 1:
+                    out_ << ")";
+                    // an else follows the first branch either way
+                    DescendBranch(*node.first_, 2, node.second_ != nullptr || contexts_.back().closed);
+                    return;
+                case 2:
+                    FinishBranch(node.second_ != nullptr || contexts_.back().closed);
+                    if (node.second_ == nullptr) {
+                        if (contexts_.back().closed) {
+                            out_ << "else {\n";
+                            Indent();
+                            out_ << "}\n";
+                        }
+                        Leave();
+                        return;
+                    }
+                    out_ << "else";
+                    DescendBranch(*node.second_, 3, contexts_.back().closed);
+                    return;
+                default:
+                    FinishBranch(false);
+                    Leave();
+                    return;
+            }
+        }
+
+        void Visit(node::LoopNode &node) override {
+            assert(node.predicat_ && node.scope_);
+            switch (GetStep()) {
+                case 0:
+                    Enter();
+                    Indent();
+                    out_ << "while (";
+                    DescendExpression(*node.predicat_, 1, true);
+                    return;
+                case 1:
+                    out_ << ")";
+                    DescendBranch(*node.scope_, 2, contexts_.back().closed);
+                    return;
+                default:
+                    FinishBranch(false);
+                    Leave();
+                    return;
+            }
+        }
+
+        void Visit(node::AssignNode &node) override {
+            assert(node.var_ && node.expr_);
+            switch (GetStep()) {
+                case 0:
+                    Enter();
+                    if (contexts_.back().statement)
+                        Indent();
+                    else
+                        out_ << "(";
+                    DescendExpression(*node.var_, 1);
+                    return;
+                case 1:
+                    out_ << " = ";
+                    DescendExpression(*node.expr_, 2, contexts_.back().statement);
+                    return;
+                default:
+                    out_ << (contexts_.back().statement ? ";\n" : ")");
+                    Leave();
+                    return;
+            }
+        }
+
+        void Visit(node::OutputNode &node) override {
+            assert(node.expr_);
+            switch (GetStep()) {
+                case 0:
+                    Enter();
+                    Indent();
+                    out_ << "print ";
+                    DescendExpression(*node.expr_, 1, true);
+                    return;
+                default:
+                    out_ << ";\n";
+                    Leave();
+                    return;
+            }
+        }
+
+    private:
+        // How the parent placed a node: as a statement or inside an
+        // expression, whether an else follows the statement, whether it is
+        // a whole expression and whether it is a scope opened on the line
+        // of its if or while
+        struct Context final {
+            bool statement = false;
+            bool closed = false;
+            bool top = false;
+            bool branch = false;
+        }; // struct Context
+
+        void Enter() {
+            contexts_.push_back(next_);
+            next_ = {};
+        }
+
+        void Leave() {
+            contexts_.pop_back();
+        }
+
+        void DescendExpression(node::Node &kid, size_t next_step, bool top = false) {
+            next_ = {};
+            next_.top = top;
+            Descend(kid, next_step);
+        }
+
+        void DescendStatement(node::Node &kid, size_t next_step, bool closed) {
+            next_ = { true, closed };
+            Descend(kid, next_step);
+        }
+
+        // A scope opens on the line of its if or while, any other branch
+        // goes on the next line, indented
+        void DescendBranch(node::Node &kid, size_t next_step, bool closed) {
+            bool scope = dynamic_cast<node::ScopeNode*>(&kid) != nullptr;
+            if (scope) {
+                out_ << " ";
+            } else {
+                out_ << "\n";
+                ++indent_;
+            }
+            outdents_.push_back(!scope);
+            next_ = { true, closed, false, scope };
+            Descend(kid, next_step);
+        }
+
+        // Leaves the line ready for an else when one follows
+        void FinishBranch(bool more) {
+            assert(!outdents_.empty());
+            if (outdents_.back()) {
+                --indent_;
+                if (more)
+                    Indent();
+            } else {
+                out_ << (more ? " " : "\n");
+            }
+            outdents_.pop_back();
+        }
+
+        void Indent() {
+            for (size_t i = 0; i < indent_; ++i)
+                out_ << "    ";
+        }
+
+        void Open() {
+            if (!contexts_.back().top)
+                out_ << "(";
+        }
+
+        void Close() {
+            if (!contexts_.back().top)
+                out_ << ")";
+        }
+
+        template <typename Node>
+        void PrintOperation(Node &node, const std::string &text) {
+            switch (GetStep()) {
+                case 0:
+                    Enter();
+                    Open();
+                    DescendExpression(*node.left_, 1);
+                    return;
+                case 1:
+                    out_ << " " << text << " ";
+                    DescendExpression(*node.right_, 2);
+                    return;
+                default:
+                    Close();
+                    Leave();
+                    return;
+            }
+        }
+
+        std::ostream &out_;
+        const intern::Interner &interner_;
+        std::vector<Context> contexts_;
+        Context next_;
+        size_t indent_ = 0;
+        std::vector<bool> outdents_;
+    }; // class PrintVisitor
+} // namespace printer
@@ -0,0 +1,197 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Wire format shared by the daemon and its client. Every message is a
+// sequence of frames, a frame is a 32-bit big-endian length and the bytes.
+//
+//   request:  "run" <source> <input>     run a script, caching it
+//             "run-hash" <hash> <input>  run a script sent before, the hash
+//                                        is the SHA-256 digest of its source
+//   response: "ok" <hash> <output> <diagnostics>
+//             "unknown" <hash>           the hash is not cached, send the source
+//
+// A connection carries any number of requests, each answered in turn.
+namespace protocol {
+    constexpr size_t MAX_FRAME_SIZE = size_t(64) << 20;
+
+    const static std::string RUN         = "run";
+    const static std::string RUN_HASH    = "run-hash";
+    const static std::string OK          = "ok";
+    const static std::string UNKNOWN     = "unknown";
+
+    namespace details {
+        constexpr std::array<uint32_t, 64> SHA256_ROUNDS = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+
+        inline uint32_t RotateRight(uint32_t value, int bits) {
+            return (value >> bits) | (value << (32 - bits));
+        }
+
+        inline void Sha256Block(std::array<uint32_t, 8> &state, const unsigned char *block) {
+            uint32_t words[64];
+            for (int i = 0; i < 16; ++i) {
+                words[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16) |
+                           (uint32_t(block[4 * i + 2]) << 8) | uint32_t(block[4 * i + 3]);
+            }
+            for (int i = 16; i < 64; ++i) {
+                auto s0 = RotateRight(words[i - 15], 7) ^ RotateRight(words[i - 15], 18) ^ (words[i - 15] >> 3);
+                auto s1 = RotateRight(words[i - 2], 17) ^ RotateRight(words[i - 2], 19) ^ (words[i - 2] >> 10);
+                words[i] = words[i - 16] + s0 + words[i - 7] + s1;
+            }
+
+            auto [a, b, c, d, e, f, g, h] = state;
+            for (int i = 0; i < 64; ++i) {
+                auto t1 = h + (RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25)) + ((e & f) ^ (~e & g)) +
+                          SHA256_ROUNDS[i] + words[i];
+                auto t2 = (RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+            std::array<uint32_t, 8> result = { a, b, c, d, e, f, g, h };
+            for (int i = 0; i < 8; ++i)
+                state[i] += result[i];
+        }
+    } // namespace details
+
+    // SHA-256 in hex. The daemon runs whatever program it has cached under
+    // a hash, so the hash has to be collision resistant.
+    inline std::string HashSource(std::string_view source) {
+        std::array<uint32_t, 8> state = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+        };
+        size_t full = source.size() / 64 * 64;
+        for (size_t offset = 0; offset < full; offset += 64)
+            details::Sha256Block(state, reinterpret_cast<const unsigned char*>(source.data() + offset));
+
+        // the rest, a one bit, zeros and the length in bits
+        unsigned char tail[128] = {};
+        auto rest = source.size() - full;
+        std::copy(source.begin() + full, source.end(), tail);
+        tail[rest] = 0x80;
+        size_t tail_size = rest < 56 ? 64 : 128;
+        uint64_t bits = uint64_t(source.size()) * 8;
+        for (int i = 0; i < 8; ++i)
+            tail[tail_size - 1 - i] = static_cast<unsigned char>(bits >> (8 * i));
+        for (size_t offset = 0; offset < tail_size; offset += 64)
+            details::Sha256Block(state, tail + offset);
+
+        char text[65];
+        for (int i = 0; i < 8; ++i)
+            std::snprintf(text + 8 * i, 9, "%08x", state[i]);
+        return text;
+    }
+
+    inline bool WriteAll(int fd, const char *data, size_t size) {
+        while (size != 0) {
+            auto written = ::send(fd, data, size, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                return false;
+            data += written;
+            size -= size_t(written);
+        }
+        return true;
+    }
+
+    inline bool ReadAll(int fd, char *data, size_t size) {
+        while (size != 0) {
+            auto got = ::read(fd, data, size);
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+                return false;
+            data += got;
+            size -= size_t(got);
+        }
+        return true;
+    }
+
+    inline bool WriteFrame(int fd, std::string_view frame) {
+        auto size = static_cast<uint32_t>(frame.size());
+        const char header[4] = { char(size >> 24), char(size >> 16), char(size >> 8), char(size) };
+        return frame.size() <= MAX_FRAME_SIZE && WriteAll(fd, header, sizeof(header)) &&
+               WriteAll(fd, frame.data(), frame.size());
+    }
+
+    inline bool ReadFrame(int fd, std::string &frame) {
+        unsigned char header[4];
+        if (!ReadAll(fd, reinterpret_cast<char*>(header), sizeof(header)))
+            return false;
+
+        size_t size = (size_t(header[0]) << 24) | (size_t(header[1]) << 16) | (size_t(header[2]) << 8) | header[3];
+        if (size > MAX_FRAME_SIZE)
+            return false;
+        frame.resize(size);
+        return ReadAll(fd, frame.data(), size);
+    }
+
+    inline bool WriteMessage(int fd, const std::vector<std::string_view> &frames) {
+        for (auto frame : frames) {
+            if (!WriteFrame(fd, frame))
+                return false;
+        }
+        return true;
+    }
+
+    enum class Parsed {
+        Complete,
+        Partial,
+        Invalid
+    };
+
+    // Takes a message off the front of the bytes received so far, the
+    // buffer is left alone unless the message is complete
+    inline Parsed ParseMessage(std::string &buffer, std::vector<std::string> &frames, size_t count) {
+        size_t offset = 0;
+        frames.resize(count);
+        for (auto &frame : frames) {
+            if (buffer.size() - offset < 4)
+                return Parsed::Partial;
+            auto header = reinterpret_cast<const unsigned char*>(buffer.data() + offset);
+            size_t size = (size_t(header[0]) << 24) | (size_t(header[1]) << 16) | (size_t(header[2]) << 8) | header[3];
+            if (size > MAX_FRAME_SIZE)
+                return Parsed::Invalid;
+            if (buffer.size() - offset - 4 < size)
+                return Parsed::Partial;
+            frame.assign(buffer, offset + 4, size);
+            offset += 4 + size;
+        }
+        buffer.erase(0, offset);
+        return Parsed::Complete;
+    }
+
+    inline bool ReadMessage(int fd, std::vector<std::string> &frames, size_t count) {
+        frames.resize(count);
+        for (auto &frame : frames) {
+            if (!ReadFrame(fd, frame))
+                return false;
+        }
+        return true;
+    }
+} // namespace protocol
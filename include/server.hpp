@@ -0,0 +1,371 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <sstream>
+#include <exception>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "driver.hpp"
+#include "protocol.hpp"
+
+namespace server {
+    // A client that does not take its response for this long is dropped
+    constexpr int SEND_TIMEOUT_SECONDS = 10;
+
+    // A parsed and optimized script. Running it only reads the program, so
+    // one instance serves any number of requests at the same time.
+    class Program final {
+    public:
+        Program(std::string source, size_t max_nesting) : driver_(std::move(source), max_nesting) {
+            driver_.Parse();
+            function_ = driver_.BuildIR(true);
+        }
+
+        void Run(std::istream &in, std::ostream &out) const {
+            ir::Executer executer(*function_, driver_.GetErrorHandler(), in, out);
+            executer.Execute();
+        }
+
+        const std::string &GetSource() const {
+            return driver_.GetSource();
+        }
+
+    private:
+        yy::Driver driver_;
+        std::unique_ptr<ir::Function> function_;
+    }; // class Program
+
+    // Least recently used programs are evicted first. Programs are keyed by
+    // the SHA-256 digest of their source, a program found for a source it
+    // does not hold is replaced.
+    class ProgramCache final {
+    public:
+        ProgramCache(size_t capacity) : capacity_(capacity) {}
+
+        std::shared_ptr<const Program> Find(const std::string &hash) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto hit = index_.find(hash);
+            if (hit == index_.end())
+                return nullptr;
+            entries_.splice(entries_.begin(), entries_, hit->second);
+            return hit->second->second;
+        }
+
+        void Insert(const std::string &hash, std::shared_ptr<const Program> program) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto hit = index_.find(hash);
+            if (hit != index_.end()) {
+                hit->second->second = std::move(program);
+                entries_.splice(entries_.begin(), entries_, hit->second);
+                return;
+            }
+
+            entries_.emplace_front(hash, std::move(program));
+            index_.emplace(hash, entries_.begin());
+            if (entries_.size() > capacity_) {
+                index_.erase(entries_.back().first);
+                entries_.pop_back();
+            }
+        }
+
+    private:
+        using Entry = std::pair<std::string, std::shared_ptr<const Program>>;
+
+        std::mutex mutex_;
+        std::list<Entry> entries_;
+        std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+        size_t capacity_;
+    }; // class ProgramCache
+
+    // Accepts connections on a Unix domain socket and hands requests to a
+    // pool of worker threads. The accepting thread polls the connections
+    // and reads what they send without blocking, a worker gets a request
+    // only once it is complete. It answers the request and gives the
+    // connection back, so neither idle clients nor clients that stop in the
+    // middle of a request hold a worker.
+    class Server final {
+    public:
+        Server(std::string socket_path, size_t workers, size_t cache_capacity, size_t max_nesting) :
+            socket_path_(std::move(socket_path)), workers_(workers), max_nesting_(max_nesting), cache_(cache_capacity) {}
+
+        Server(const Server&) = delete;
+        Server &operator=(const Server&) = delete;
+
+        ~Server() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopped_ = true;
+            }
+            ready_.notify_all();
+            for (auto &thread : threads_)
+                thread.join();
+            for (auto &request : pending_)
+                ::close(request.fd);
+            for (auto [fd, open] : returned_)
+                ::close(fd);
+            for (auto fd : idle_)
+                ::close(fd);
+            for (auto fd : wake_) {
+                if (fd >= 0)
+                    ::close(fd);
+            }
+            if (listen_fd_ >= 0)
+                ::close(listen_fd_);
+            if (bound_)
+                ::unlink(socket_path_.c_str());
+        }
+
+        // Serves until accepting a connection or polling fails
+        void Run() {
+            Listen();
+            // a full pipe already wakes the accepting thread, so neither end blocks
+            if (::pipe2(wake_, O_NONBLOCK) < 0)
+                throw std::runtime_error(std::string("pipe: ") + std::strerror(errno));
+            for (size_t i = 0; i < workers_; ++i)
+                threads_.emplace_back([this] { Work(); });
+
+            std::vector<pollfd> polled;
+            for (;;) {
+                polled.clear();
+                polled.push_back({ listen_fd_, POLLIN, 0 });
+                polled.push_back({ wake_[0], POLLIN, 0 });
+                for (auto fd : idle_)
+                    polled.push_back({ fd, POLLIN, 0 });
+                if (::poll(polled.data(), polled.size(), -1) < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    throw std::runtime_error(std::string("poll: ") + std::strerror(errno));
+                }
+
+                std::vector<int> waiting;
+                for (size_t i = 2; i < polled.size(); ++i) {
+                    auto fd = polled[i].fd;
+                    if (polled[i].revents == 0 || Take(fd, true))
+                        waiting.push_back(fd);
+                }
+                idle_ = std::move(waiting);
+
+                if (polled[1].revents != 0)
+                    TakeReturned();
+                if (polled[0].revents != 0)
+                    Accept();
+            }
+        }
+
+    private:
+        void Listen() {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            if (socket_path_.size() >= sizeof(address.sun_path))
+                throw std::invalid_argument("Socket path is too long");
+            std::memcpy(address.sun_path, socket_path_.c_str(), socket_path_.size() + 1);
+
+            // a socket left by an earlier run is replaced, any other file is kept
+            struct stat status;
+            if (::lstat(socket_path_.c_str(), &status) == 0) {
+                if (!S_ISSOCK(status.st_mode))
+                    throw std::invalid_argument(socket_path_ + " exists and is not a socket");
+                ::unlink(socket_path_.c_str());
+            } else if (errno != ENOENT) {
+                throw std::runtime_error(std::string("lstat: ") + std::strerror(errno));
+            }
+
+            listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (listen_fd_ < 0)
+                throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+
+            if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+                throw std::runtime_error(std::string("bind: ") + std::strerror(errno));
+            bound_ = true;
+            if (::listen(listen_fd_, SOMAXCONN) < 0)
+                throw std::runtime_error(std::string("listen: ") + std::strerror(errno));
+            // accepting is driven by poll, a client that gave up in between
+            // must not block it
+            if (::fcntl(listen_fd_, F_SETFL, ::fcntl(listen_fd_, F_GETFL) | O_NONBLOCK) < 0)
+                throw std::runtime_error(std::string("fcntl: ") + std::strerror(errno));
+        }
+
+        void Accept() {
+            for (;;) {
+                int fd = ::accept(listen_fd_, nullptr, nullptr);
+                if (fd >= 0) {
+                    timeval timeout{ SEND_TIMEOUT_SECONDS, 0 };
+                    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                    idle_.push_back(fd);
+                    continue;
+                }
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    return;
+                throw std::runtime_error(std::string("accept: ") + std::strerror(errno));
+            }
+        }
+
+        // Connections workers gave back wait for their next request, one
+        // the client sent already goes to a worker at once
+        void TakeReturned() {
+            char wakes[64];
+            while (::read(wake_[0], wakes, sizeof(wakes)) > 0) {}
+
+            std::vector<std::pair<int, bool>> returned;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                returned.swap(returned_);
+            }
+            for (auto [fd, open] : returned) {
+                if (!open)
+                    Drop(fd);
+                else if (Take(fd, false))
+                    idle_.push_back(fd);
+            }
+        }
+
+        // Reads what the client sent if it is readable and queues the
+        // request once it is complete. True if the connection still waits
+        // for the rest of a request.
+        bool Take(int fd, bool readable) {
+            auto &buffer = received_[fd];
+            bool open = !readable || Receive(fd, buffer);
+
+            Request request{ fd, {} };
+            switch (protocol::ParseMessage(buffer, request.frames, 3)) {
+                case protocol::Parsed::Complete:
+                    {
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        pending_.push_back(std::move(request));
+                    }
+                    ready_.notify_one();
+                    return false;
+                case protocol::Parsed::Partial:
+                    if (open)
+                        return true;
+                    break;
+                case protocol::Parsed::Invalid:
+                    break;
+            }
+            Drop(fd);
+            return false;
+        }
+
+        // False once the client closed the connection or it failed
+        static bool Receive(int fd, std::string &buffer) {
+            char chunk[1 << 16];
+            for (;;) {
+                auto got = ::recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+                if (got > 0) {
+                    buffer.append(chunk, size_t(got));
+                    continue;
+                }
+                if (got < 0 && errno == EINTR)
+                    continue;
+                return got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+            }
+        }
+
+        void Drop(int fd) {
+            received_.erase(fd);
+            ::close(fd);
+        }
+
+        void Work() {
+            for (;;) {
+                Request request;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    ready_.wait(lock, [this] { return stopped_ || !pending_.empty(); });
+                    if (stopped_)
+                        return;
+                    request = std::move(pending_.front());
+                    pending_.pop_front();
+                }
+
+                bool open = Serve(request.fd, request.frames);
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    returned_.emplace_back(request.fd, open);
+                }
+                const char wake = 0;
+                while (::write(wake_[1], &wake, 1) < 0 && errno == EINTR) {}
+            }
+        }
+
+        // Answers one request, false once the connection is done with
+        bool Serve(int fd, std::vector<std::string> &request) {
+            auto &command = request[0];
+            auto &script = request[1];
+            auto &input = request[2];
+            if (command != protocol::RUN && command != protocol::RUN_HASH)
+                return false;
+
+            bool by_hash = command == protocol::RUN_HASH;
+            auto hash = by_hash ? script : protocol::HashSource(script);
+            auto program = cache_.Find(hash);
+            // a source is run only by a program compiled from it
+            if (program != nullptr && !by_hash && program->GetSource() != script)
+                program = nullptr;
+            if (program == nullptr && by_hash)
+                return protocol::WriteMessage(fd, { protocol::UNKNOWN, hash });
+
+            std::ostringstream output;
+            std::string diagnostics;
+            try {
+                if (program == nullptr) {
+                    program = std::make_shared<const Program>(std::move(script), max_nesting_);
+                    cache_.Insert(hash, program);
+                }
+
+                std::istringstream in(input);
+                program->Run(in, output);
+            } catch (std::exception &ex) {
+                diagnostics = ex.what();
+            }
+
+            return protocol::WriteMessage(fd, { protocol::OK, hash, output.str(), diagnostics });
+        }
+
+        std::string socket_path_;
+        size_t workers_;
+        size_t max_nesting_;
+        ProgramCache cache_;
+
+        int listen_fd_ = -1;
+        bool bound_ = false;
+        std::vector<std::thread> threads_;
+        std::mutex mutex_;
+        std::condition_variable ready_;
+        struct Request final {
+            int fd = -1;
+            std::vector<std::string> frames;
+        }; // struct Request
+
+        // complete requests, and the connections workers gave back with
+        // whether they stay open
+        std::deque<Request> pending_;
+        std::vector<std::pair<int, bool>> returned_;
+        bool stopped_ = false;
+        // owned by the accepting thread: connections waiting for a request
+        // and what each of them sent so far
+        std::vector<int> idle_;
+        std::unordered_map<int, std::string> received_;
+        int wake_[2] = { -1, -1 };
+    }; // class Server
+} // namespace server
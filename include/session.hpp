@@ -0,0 +1,258 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+#include <limits>
+#include <cctype>
+
+#include "driver.hpp"
+#include "executer.hpp"
+
+namespace session {
+    // Nodes a session runs before it yields its thread to the next one
+    constexpr size_t DEFAULT_SLICE = 20000;
+
+    // Input that arrives in pieces. A number is read once the character
+    // after it has arrived or the input is closed, so a number split
+    // between two pieces is read whole.
+    class InputBuffer final : public executer::Input {
+    public:
+        void Append(std::string_view data) {
+            data_.erase(0, pos_);
+            pos_ = 0;
+            data_ += data;
+        }
+
+        void Close() {
+            closed_ = true;
+        }
+
+        std::optional<int> Read() override {
+            if (failed_)
+                return 0;
+
+            size_t pos = pos_;
+            while (pos < data_.size() && std::isspace(static_cast<unsigned char>(data_[pos])))
+                ++pos;
+
+            size_t digits = pos;
+            if (digits < data_.size() && (data_[digits] == '-' || data_[digits] == '+'))
+                ++digits;
+            size_t end = digits;
+            while (end < data_.size() && std::isdigit(static_cast<unsigned char>(data_[end])))
+                ++end;
+            if (end == data_.size() && !closed_)
+                return std::nullopt;
+
+            pos_ = end;
+            if (end == digits) {
+                failed_ = true;
+                return 0;
+            }
+
+            // saturates like std::cin and fails the following reads
+            bool negative = data_[pos] == '-';
+            long long value = 0;
+            for (size_t i = digits; i < end && value <= std::numeric_limits<int>::max(); ++i)
+                value = value * 10 + (data_[i] - '0');
+            value = negative ? -value : value;
+            if (value > std::numeric_limits<int>::max()) {
+                failed_ = true;
+                return std::numeric_limits<int>::max();
+            }
+            if (value < std::numeric_limits<int>::min()) {
+                failed_ = true;
+                return std::numeric_limits<int>::min();
+            }
+            return int(value);
+        }
+
+    private:
+        std::string data_;
+        size_t pos_ = 0;
+        bool closed_ = false;
+        bool failed_ = false;
+    }; // class InputBuffer
+
+    enum class State {
+        Ready,
+        Running,
+        Waiting,
+        Finished
+    };
+
+    // One run of a program. The parsed program is shared by every session
+    // running it, a session owns only the state of its run: the frames of
+    // the walk, the values and the variables.
+    class Session final {
+    public:
+        Session(std::shared_ptr<const yy::Driver> program) :
+            program_(std::move(program)),
+            executer_(program_->GetErrorHandler(), program_->GetInterner(), input_, slice_output_, &program_->GetLoops()) {
+            executer_.Start(*program_->GetRootNode());
+        }
+
+        Session(const Session&) = delete;
+        Session &operator=(const Session&) = delete;
+
+    private:
+        friend class Scheduler;
+
+        std::shared_ptr<const yy::Driver> program_;
+        InputBuffer input_;
+        std::ostringstream slice_output_;
+        executer::ExecuteVisitor executer_;
+
+        // guarded by the scheduler
+        State state_ = State::Ready;
+        std::string pending_input_;
+        bool input_closed_ = false;
+        std::string output_;
+        std::string diagnostics_;
+    }; // class Session
+
+    // Runs sessions on a few threads. A session holds a thread for one slice
+    // at most and goes to the back of the queue, so long loops share the
+    // threads fairly; a session that waits for input leaves the queue until
+    // the input arrives.
+    class Scheduler final {
+    public:
+        Scheduler(size_t threads, size_t slice = DEFAULT_SLICE) : slice_(slice) {
+            for (size_t i = 0; i < threads; ++i)
+                threads_.emplace_back([this] { Work(); });
+        }
+
+        Scheduler(const Scheduler&) = delete;
+        Scheduler &operator=(const Scheduler&) = delete;
+
+        ~Scheduler() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopped_ = true;
+            }
+            ready_.notify_all();
+            for (auto &thread : threads_)
+                thread.join();
+        }
+
+        std::shared_ptr<Session> Spawn(std::shared_ptr<const yy::Driver> program) {
+            auto session = std::make_shared<Session>(std::move(program));
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                Enqueue(session);
+            }
+            ready_.notify_one();
+            return session;
+        }
+
+        void Feed(const std::shared_ptr<Session> &session, std::string_view input) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            session->pending_input_ += input;
+            Wake(session);
+        }
+
+        // Reads past the end of the input yield zero instead of waiting
+        void CloseInput(const std::shared_ptr<Session> &session) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            session->input_closed_ = true;
+            Wake(session);
+        }
+
+        // Output written since the last call
+        std::string TakeOutput(const std::shared_ptr<Session> &session) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return std::move(session->output_);
+        }
+
+        State GetState(const std::shared_ptr<Session> &session) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return session->state_;
+        }
+
+        // The error that finished the session, empty if it ran to the end
+        std::string GetDiagnostics(const std::shared_ptr<Session> &session) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return session->diagnostics_;
+        }
+
+        // Blocks until the session waits for input or is finished
+        State Wait(const std::shared_ptr<Session> &session) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            settled_.wait(lock, [&session] {
+                return session->state_ == State::Waiting || session->state_ == State::Finished;
+            });
+            return session->state_;
+        }
+
+    private:
+        void Enqueue(std::shared_ptr<Session> session) {
+            session->state_ = State::Ready;
+            queue_.push_back(std::move(session));
+        }
+
+        void Wake(const std::shared_ptr<Session> &session) {
+            if (session->state_ != State::Waiting)
+                return;
+            Enqueue(session);
+            ready_.notify_one();
+        }
+
+        void Work() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            for (;;) {
+                ready_.wait(lock, [this] { return stopped_ || !queue_.empty(); });
+                if (stopped_)
+                    return;
+                auto session = std::move(queue_.front());
+                queue_.pop_front();
+                session->state_ = State::Running;
+                session->input_.Append(session->pending_input_);
+                session->pending_input_.clear();
+                if (session->input_closed_)
+                    session->input_.Close();
+
+                lock.unlock();
+                bool done = true;
+                std::string diagnostics;
+                try {
+                    done = session->executer_.Resume(slice_);
+                } catch (std::exception &ex) {
+                    diagnostics = ex.what();
+                }
+                auto output = session->slice_output_.str();
+                session->slice_output_.str({});
+                lock.lock();
+
+                session->output_ += output;
+                if (done) {
+                    session->state_ = State::Finished;
+                    session->diagnostics_ = std::move(diagnostics);
+                } else if (!session->executer_.IsWaitingForInput() ||
+                           !session->pending_input_.empty() || session->input_closed_) {
+                    Enqueue(std::move(session));
+                    ready_.notify_one();
+                    continue;
+                } else {
+                    session->state_ = State::Waiting;
+                }
+                settled_.notify_all();
+            }
+        }
+
+        size_t slice_;
+        std::vector<std::thread> threads_;
+        std::mutex mutex_;
+        std::condition_variable ready_;
+        std::condition_variable settled_;
+        std::deque<std::shared_ptr<Session>> queue_;
+        bool stopped_ = false;
+    }; // class Scheduler
+} // namespace session
@@ -0,0 +1,1237 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <memory>
+#include <limits>
+#include <istream>
+#include <ostream>
+#include <charconv>
+#include <stdexcept>
+#include <cassert>
+
+#include "error_handler.hpp"
+#include "interner.hpp"
+#include "node.hpp"
+#include "executer.hpp"
+#include "induction.hpp"
+#include "printer.hpp"
+
+namespace specializer {
+    // Nodes the specializer visits before it leaves every loop it has not
+    // finished to the residual program
+    constexpr size_t DEFAULT_MAX_STEPS = 50000000;
+    // Iterations of one run of a loop that may leave code behind before the
+    // rest of the run is left to the residual program
+    constexpr size_t DEFAULT_MAX_UNROLL = 64;
+
+    // The numbers a program will read first, nothing where a number is not
+    // known in advance
+    using KnownInput = std::vector<std::optional<int>>;
+
+    // Whitespace separated integers, '?' stands for a number not known
+    inline KnownInput ParseKnownInput(std::istream &in) {
+        KnownInput known;
+        std::string token;
+        while (in >> token) {
+            if (token == "?") {
+                known.emplace_back();
+                continue;
+            }
+            int number = 0;
+            auto begin = token.data() + (token[0] == '+');
+            auto [end, error] = std::from_chars(begin, token.data() + token.size(), number);
+            if (error != std::errc{} || end != token.data() + token.size())
+                throw std::invalid_argument("Invalid number '" + token + "' in the known input");
+            known.push_back(number);
+        }
+        return known;
+    }
+
+    // What running a subtree may do to the state around it
+    struct Effects final {
+        // names assigned anywhere in it
+        std::vector<intern::Atom> assigned;
+        // names assigned outside of its nested scopes, the only ones it may
+        // declare in the scope around it
+        std::vector<intern::Atom> direct;
+        bool reads = false;
+
+        void Merge(const Effects &other) {
+            for (auto name : other.assigned) {
+                if (std::find(assigned.begin(), assigned.end(), name) == assigned.end())
+                    assigned.push_back(name);
+            }
+            for (auto name : other.direct) {
+                if (std::find(direct.begin(), direct.end(), name) == direct.end())
+                    direct.push_back(name);
+            }
+            reads = reads || other.reads;
+        }
+    }; // struct Effects
+
+    namespace details {
+        class EffectsVisitor final : public node::WalkVisitor {
+        public:
+            Effects Collect(node::Node &root) {
+                effects_ = {};
+                assigned_.clear();
+                direct_.clear();
+                depth_ = 0;
+                Walk(root);
+                return std::move(effects_);
+            }
+
+            void Visit(node::LogicOpNode &node) override {
+                DescendNext({ node.left_, node.right_ });
+            }
+
+            void Visit(node::UnOpNode &node) override {
+                DescendNext({ node.child_ });
+            }
+
+            void Visit(node::BinOpNode &node) override {
+                DescendNext({ node.left_, node.right_ });
+            }
+
+            void Visit(node::BinCompOpNode &node) override {
+                DescendNext({ node.left_, node.right_ });
+            }
+
+            void Visit(node::NumberNode &node) override {}
+
+            void Visit(node::InputNode &node) override {
+                effects_.reads = true;
+            }
+
+            void Visit(node::VarNode &node) override {}
+
+            void Visit(node::ScopeNode &node) override {
+                if (GetStep() == 0)
+                    ++depth_;
+                if (!DescendNext(node.kids_))
+                    --depth_;
+            }
+
+            void Visit(node::DeclNode &node) override {}
+
+            void Visit(node::CondNode &node) override {
+                DescendNext({ node.predicat_, node.first_, node.second_ });
+            }
+
+            void Visit(node::LoopNode &node) override {
+                DescendNext({ node.predicat_, node.scope_ });
+            }
+
+            void Visit(node::AssignNode &node) override {
+                if (GetStep() == 0) {
+                    auto name = node.var_->name_;
+                    if (assigned_.insert(name).second)
+                        effects_.assigned.push_back(name);
+                    if (depth_ == 0 && direct_.insert(name).second)
+                        effects_.direct.push_back(name);
+                }
+                DescendNext({ node.expr_ });
+            }
+
+            void Visit(node::OutputNode &node) override {
+                DescendNext({ node.expr_ });
+            }
+
+        private:
+            Effects effects_;
+            std::unordered_set<intern::Atom> assigned_;
+            std::unordered_set<intern::Atom> direct_;
+            size_t depth_ = 0;
+        }; // class EffectsVisitor
+
+        // Whether residual code reads one of the names, or any input
+        class TouchVisitor final : public node::WalkVisitor {
+        public:
+            bool Touches(node::Node &root, const std::unordered_set<intern::Atom> &names, bool input) {
+                names_ = &names;
+                input_ = input;
+                touches_ = false;
+                Walk(root);
+                return touches_;
+            }
+
+            void Visit(node::LogicOpNode &node) override {
+                DescendUnlessTouched({ node.left_, node.right_ });
+            }
+
+            void Visit(node::UnOpNode &node) override {
+                DescendUnlessTouched({ node.child_ });
+            }
+
+            void Visit(node::BinOpNode &node) override {
+                DescendUnlessTouched({ node.left_, node.right_ });
+            }
+
+            void Visit(node::BinCompOpNode &node) override {
+                DescendUnlessTouched({ node.left_, node.right_ });
+            }
+
+            void Visit(node::NumberNode &node) override {}
+
+            void Visit(node::InputNode &node) override {
+                touches_ = touches_ || input_;
+            }
+
+            void Visit(node::VarNode &node) override {
+                touches_ = touches_ || names_->count(node.name_) != 0;
+            }
+
+            void Visit(node::ScopeNode &node) override {
+                DescendUnlessTouched(node.kids_);
+            }
+
+            void Visit(node::DeclNode &node) override {}
+
+            void Visit(node::CondNode &node) override {
+                DescendUnlessTouched({ node.predicat_, node.first_, node.second_ });
+            }
+
+            void Visit(node::LoopNode &node) override {
+                DescendUnlessTouched({ node.predicat_, node.scope_ });
+            }
+
+            void Visit(node::AssignNode &node) override {
+                DescendUnlessTouched({ node.expr_ });
+            }
+
+            void Visit(node::OutputNode &node) override {
+                DescendUnlessTouched({ node.expr_ });
+            }
+
+        private:
+            template <typename Kids>
+            void DescendUnlessTouched(const Kids &kids) {
+                if (!touches_)
+                    DescendNext(kids);
+            }
+
+            void DescendUnlessTouched(std::initializer_list<node::Node*> kids) {
+                if (!touches_)
+                    DescendNext(kids);
+            }
+
+            const std::unordered_set<intern::Atom> *names_ = nullptr;
+            bool input_ = false;
+            bool touches_ = false;
+        }; // class TouchVisitor
+
+        // Copies a subtree into the residual program. Variables the lookup
+        // knows become numbers, operations on numbers are folded and code
+        // that can never run is dropped, a statement that is dropped as a
+        // whole copies to null. Division by zero is left to the run.
+        class CopyVisitor final : public node::WalkVisitor {
+        public:
+            using Lookup = std::function<std::optional<int>(intern::Atom)>;
+
+            CopyVisitor(node::details::Builder<node::Node> &builder, Lookup lookup) :
+                builder_(builder), lookup_(std::move(lookup)) {}
+
+            node::Node *CopyStatement(node::Node &root) {
+                results_.clear();
+                Walk(root);
+                assert(results_.size() == 1);
+                return ToCode(results_.back(), root.location_);
+            }
+
+            node::ExprNode *CopyExpression(node::ExprNode &root) {
+                return static_cast<node::ExprNode*>(CopyStatement(root));
+            }
+
+            void Visit(node::LogicOpNode &node) override {
+                if (DescendNext({ node.left_, node.right_ }))
+                    return;
+                auto right = PopResult();
+                auto left = PopResult();
+                if (left.number) {
+                    bool decided = node.type_ == node::LogicOpNode_t::logic_and ? !*left.number : *left.number;
+                    if (decided) {
+                        PushNumber(node.type_ == node::LogicOpNode_t::logic_or);
+                        return;
+                    }
+                    if (right.number) {
+                        PushNumber(bool(*right.number));
+                        return;
+                    }
+                }
+                PushCode(Make<node::LogicOpNode>(node.type_, Expr(left, node), Expr(right, node), node.location_));
+            }
+
+            void Visit(node::UnOpNode &node) override {
+                if (DescendNext({ node.child_ }))
+                    return;
+                auto child = PopResult();
+                if (child.number) {
+                    PushNumber(node.type_ == node::UnOpNode_t::minus ? executer::Arithmetic<int>::Neg(*child.number) :
+                                                                        !*child.number);
+                    return;
+                }
+                PushCode(Make<node::UnOpNode>(node.type_, Expr(child, node), node.location_));
+            }
+
+            void Visit(node::BinOpNode &node) override {
+                if (DescendNext({ node.left_, node.right_ }))
+                    return;
+                auto right = PopResult();
+                auto left = PopResult();
+                if (left.number && right.number) {
+                    if (auto number = Fold(node.type_, *left.number, *right.number)) {
+                        PushNumber(*number);
+                        return;
+                    }
+                }
+                PushCode(Make<node::BinOpNode>(node.type_, Expr(left, node), Expr(right, node), node.location_));
+            }
+
+            void Visit(node::BinCompOpNode &node) override {
+                if (DescendNext({ node.left_, node.right_ }))
+                    return;
+                auto right = PopResult();
+                auto left = PopResult();
+                if (left.number && right.number) {
+                    PushNumber(Compare(node.type_, *left.number, *right.number));
+                    return;
+                }
+                PushCode(Make<node::BinCompOpNode>(node.type_, Expr(left, node), Expr(right, node), node.location_));
+            }
+
+            void Visit(node::NumberNode &node) override {
+                PushNumber(node.number_);
+            }
+
+            void Visit(node::InputNode &node) override {
+                PushCode(Make<node::InputNode>(node.location_));
+            }
+
+            void Visit(node::VarNode &node) override {
+                if (auto number = lookup_(node.name_)) {
+                    PushNumber(*number);
+                    return;
+                }
+                PushCode(Make<node::VarNode>(node.name_, node.location_));
+            }
+
+            void Visit(node::ScopeNode &node) override {
+                if (GetStep() == 0)
+                    marks_.push_back(results_.size());
+                if (DescendNext(node.kids_))
+                    return;
+
+                auto scope = Make<node::ScopeNode>(node.location_);
+                for (auto i = marks_.back(); i < results_.size(); ++i) {
+                    if (results_[i].code != nullptr)
+                        scope->AddStatement(results_[i].code);
+                }
+                results_.resize(marks_.back());
+                marks_.pop_back();
+                PushCode(scope->kids_.empty() ? nullptr : scope);
+            }
+
+            void Visit(node::DeclNode &node) override {}
+
+            void Visit(node::CondNode &node) override {
+                if (DescendNext({ node.predicat_, node.first_, node.second_ }))
+                    return;
+                auto second = node.second_ ? PopResult().code : nullptr;
+                auto first = PopResult().code;
+                auto predicat = PopResult();
+                if (predicat.number) {
+                    PushCode(*predicat.number ? first : second);
+                    return;
+                }
+                PushCode(Make<node::CondNode>(Expr(predicat, node), OrEmpty(first, node), second, node.location_));
+            }
+
+            void Visit(node::LoopNode &node) override {
+                if (DescendNext({ node.predicat_, node.scope_ }))
+                    return;
+                auto scope = PopResult().code;
+                auto predicat = PopResult();
+                if (predicat.number && !*predicat.number) {
+                    PushCode(nullptr);
+                    return;
+                }
+                PushCode(Make<node::LoopNode>(Expr(predicat, node), OrEmpty(scope, node), node.location_));
+            }
+
+            void Visit(node::AssignNode &node) override {
+                if (DescendNext({ node.expr_ }))
+                    return;
+                auto expr = Expr(PopResult(), node);
+                auto var = Make<node::DeclNode>(node.var_->name_, node.var_->location_);
+                PushCode(Make<node::AssignNode>(var, expr, node.location_));
+            }
+
+            void Visit(node::OutputNode &node) override {
+                if (DescendNext({ node.expr_ }))
+                    return;
+                PushCode(Make<node::OutputNode>(Expr(PopResult(), node), node.location_));
+            }
+
+            static std::optional<int> Fold(node::BinOpNode_t type, int lhs, int rhs) {
+                switch (type) {
+                    case node::BinOpNode_t::add:
+                        return executer::Arithmetic<int>::Add(lhs, rhs);
+                    case node::BinOpNode_t::sub:
+                        return executer::Arithmetic<int>::Sub(lhs, rhs);
+                    case node::BinOpNode_t::mul:
+                        return executer::Arithmetic<int>::Mul(lhs, rhs);
+                    case node::BinOpNode_t::div:
+                        if (rhs == 0)
+                            return std::nullopt;
+                        return executer::Arithmetic<int>::Div(lhs, rhs);
+                    case node::BinOpNode_t::remainder:
+                        if (rhs == 0)
+                            return std::nullopt;
+                        return executer::Arithmetic<int>::Rem(lhs, rhs);
+                }
+                return std::nullopt;
+            }
+
+            static int Compare(node::BinCompOpNode_t type, int lhs, int rhs) {
+                switch (type) {
+                    case node::BinCompOpNode_t::equal:
+                        return lhs == rhs;
+                    case node::BinCompOpNode_t::not_equal:
+                        return lhs != rhs;
+                    case node::BinCompOpNode_t::greater:
+                        return lhs > rhs;
+                    case node::BinCompOpNode_t::less:
+                        return lhs < rhs;
+                    case node::BinCompOpNode_t::greater_or_equal:
+                        return lhs >= rhs;
+                    case node::BinCompOpNode_t::less_or_equal:
+                        return lhs <= rhs;
+                }
+                return 0;
+            }
+
+        private:
+            // A number known now, or the code of the copy
+            struct Result final {
+                std::optional<int> number;
+                node::Node *code = nullptr;
+            }; // struct Result
+
+            template <typename T, typename... Args>
+            T *Make(Args&&... args) {
+                return builder_.template GetObj<T>(std::forward<Args>(args)...);
+            }
+
+            node::Node *ToCode(const Result &result, const yy::Location &location) {
+                if (result.number)
+                    return Make<node::NumberNode>(*result.number, location);
+                return result.code;
+            }
+
+            node::ExprNode *Expr(const Result &result, const node::Node &parent) {
+                return static_cast<node::ExprNode*>(ToCode(result, parent.location_));
+            }
+
+            // A branch or a body that copies to nothing still needs a statement
+            node::Node *OrEmpty(node::Node *code, const node::Node &parent) {
+                return code != nullptr ? code : Make<node::ScopeNode>(parent.location_);
+            }
+
+            Result PopResult() {
+                assert(!results_.empty());
+                auto result = results_.back();
+                results_.pop_back();
+                return result;
+            }
+
+            void PushNumber(int number) {
+                results_.push_back({ number, nullptr });
+            }
+
+            void PushCode(node::Node *code) {
+                results_.push_back({ std::nullopt, code });
+            }
+
+            node::details::Builder<node::Node> &builder_;
+            Lookup lookup_;
+            std::vector<Result> results_;
+            std::vector<size_t> marks_;
+        }; // class CopyVisitor
+    } // namespace details
+
+    // The program that is left once everything the known input decides has
+    // been done. It keeps the locations of the program it came from, so run
+    // with that program's error handler it reports errors the same way.
+    class Residual final {
+    public:
+        // Atoms of the program stay valid in the residual program
+        Residual(const intern::Interner &interner) {
+            for (intern::Atom atom = 0; atom < interner.GetSize(); ++atom)
+                interner_.Intern(interner.GetName(atom));
+        }
+
+        Residual(const Residual&) = delete;
+        Residual &operator=(const Residual&) = delete;
+
+        node::Node *GetRootNode() const {
+            return root_;
+        }
+
+        const intern::Interner &GetInterner() const {
+            return interner_;
+        }
+
+        void Print(std::ostream &out) const {
+            printer::PrintVisitor(out, interner_).Print(*root_);
+        }
+
+        // The input is the whole input of the program, known part included
+        void Execute(const err::ErrorHandler &err_handler, std::istream &in, std::ostream &out, bool optimize = true) const {
+            executer::StreamInput input(in);
+            executer::ExecuteVisitor executer(err_handler, interner_, input, out, optimize ? &loops_ : nullptr);
+            executer.Execute(*root_);
+        }
+
+    private:
+        friend class SpecializeVisitor;
+
+        node::details::Builder<node::Node> builder_;
+        intern::Interner interner_;
+        node::Node *root_ = nullptr;
+        induction::Analysis loops_;
+    }; // class Residual
+
+    // Runs a program as far as the known input decides it and writes down
+    // what is left. Variables hold either a number known now or are left to
+    // the run; statements on known values are done here, a print of a known
+    // value becomes a print of a number, conditions and loops on known
+    // values are decided and unrolled. What depends on unknown values goes
+    // to the residual program: a condition or loop whose predicate is not
+    // known is copied with the numbers known around it folded in, and the
+    // variables it may assign are left to the run from then on.
+    //
+    // The residual program reads the same input as the program. Numbers read
+    // here are skipped by the residual program before its first read of its
+    // own, and not read at all if it never reads. Once code that may or may
+    // not read runs, how much input is gone is not known anymore, and later
+    // reads are all left to the run.
+    //
+    // A variable declared here lives on in the residual program only once
+    // residual code assigns it. Names are never shadowed, a variable is
+    // declared only where no binding of its name exists, so such a
+    // declaration is put into the residual scope of the variable, before
+    // the scope that is open in it.
+    //
+    // An error on known values, a division by zero or an undeclared
+    // variable, is left in the residual program at its place and ends the
+    // specialization there.
+    class SpecializeVisitor final : public node::WalkVisitor {
+    public:
+        SpecializeVisitor(const intern::Interner &interner, const KnownInput &known,
+                          const induction::Analysis *loops = nullptr,
+                          size_t max_steps = DEFAULT_MAX_STEPS, size_t max_unroll = DEFAULT_MAX_UNROLL) :
+            interner_(interner), known_(known), loops_(loops), max_steps_(max_steps), max_unroll_(max_unroll) {}
+
+        std::unique_ptr<Residual> Specialize(node::Node &root) {
+            residual_ = std::make_unique<Residual>(interner_);
+            values_.clear();
+            bindings_.clear();
+            scopes_.clear();
+            blocks_.clear();
+            runs_.clear();
+            position_ = skipped_ = statement_skipped_ = emitted_ = 0;
+            input_known_ = true;
+            failed_ = halted_ = over_budget_ = false;
+            skip_name_.reset();
+            test_name_.reset();
+            first_name_.reset();
+
+            Start(root);
+            for (size_t steps = 0; !Resume(STEP_CHUNK);) {
+                steps += STEP_CHUNK;
+                over_budget_ = steps >= max_steps_;
+            }
+            assert(residual_->root_ != nullptr);
+            residual_->loops_.Analyze(*residual_->root_);
+            return std::move(residual_);
+        }
+
+        void Visit(node::LogicOpNode &node) override {
+            switch (GetStep()) {
+                case 0:
+                    assert(node.left_);
+                    if (!Evaluate(*node.left_, 1))
+                        return;
+                    [[fallthrough]];
+                case 1: {
+                    auto left = PopValue();
+                    bool is_and = node.type_ == node::LogicOpNode_t::logic_and;
+                    if (!left.number) {
+                        // the right operand runs only on some runs, it goes
+                        // to the residual program as it is
+                        assert(node.right_);
+                        auto catch_up = Generalize(GetEffects(*node.right_), node.location_);
+                        auto code = AppendCatchUp(left.code, catch_up, node.location_);
+                        PushCode(Make<node::LogicOpNode>(node.type_, code, CopyExpression(*node.right_), node.location_));
+                        return;
+                    }
+                    if (is_and ? !*left.number : *left.number) {
+                        PushNumber(!is_and);
+                        return;
+                    }
+                    assert(node.right_);
+                    if (!Evaluate(*node.right_, 2))
+                        return;
+                    [[fallthrough]];
+                }
+                default: {
+                    auto right = PopValue();
+                    if (right.number) {
+                        PushNumber(bool(*right.number));
+                        return;
+                    }
+                    // the left operand did not decide, it was true for and, false for or
+                    auto left = Make<node::NumberNode>(node.type_ == node::LogicOpNode_t::logic_and, node.location_);
+                    PushCode(Make<node::LogicOpNode>(node.type_, left, right.code, node.location_));
+                    return;
+                }
+            }
+        }
+
+        void Visit(node::UnOpNode &node) override {
+            assert(node.child_);
+            if (GetStep() == 0 && !Evaluate(*node.child_, 1))
+                return;
+            auto child = PopValue();
+            if (!child.number) {
+                PushCode(Make<node::UnOpNode>(node.type_, child.code, node.location_));
+                return;
+            }
+            PushNumber(node.type_ == node::UnOpNode_t::minus ? executer::Arithmetic<int>::Neg(*child.number) :
+                                                                !*child.number);
+        }
+
+        void Visit(node::BinOpNode &node) override {
+            if (!EvaluateOperands(node))
+                return;
+            auto right = PopValue();
+            auto left = PopValue();
+            if (left.number && right.number) {
+                if (auto number = details::CopyVisitor::Fold(node.type_, *left.number, *right.number)) {
+                    PushNumber(*number);
+                    return;
+                }
+                // division by zero, the residual program reports it
+                failed_ = true;
+            }
+            PushCode(Make<node::BinOpNode>(node.type_, ToCode(left, node), ToCode(right, node), node.location_));
+        }
+
+        void Visit(node::BinCompOpNode &node) override {
+            if (!EvaluateOperands(node))
+                return;
+            auto right = PopValue();
+            auto left = PopValue();
+            if (left.number && right.number) {
+                PushNumber(details::CopyVisitor::Compare(node.type_, *left.number, *right.number));
+                return;
+            }
+            PushCode(Make<node::BinCompOpNode>(node.type_, ToCode(left, node), ToCode(right, node), node.location_));
+        }
+
+        void Visit(node::NumberNode &node) override {
+            PushNumber(node.number_);
+        }
+
+        void Visit(node::InputNode &node) override {
+            if (input_known_) {
+                auto index = position_++;
+                if (index < known_.size() && known_[index]) {
+                    ++skipped_;
+                    PushNumber(*known_[index]);
+                    return;
+                }
+            }
+            PushCode(Read(node.location_));
+        }
+
+        void Visit(node::VarNode &node) override {
+            auto binding = Find(node.name_);
+            if (binding != nullptr && binding->number) {
+                PushNumber(*binding->number);
+                return;
+            }
+            // not declared, the residual program reports it
+            if (binding == nullptr)
+                failed_ = true;
+            PushCode(Make<node::VarNode>(node.name_, node.location_));
+        }
+
+        void Visit(node::ScopeNode &node) override {
+            if (GetStep() == 0)
+                PushScope(node.location_);
+            else
+                FinishStatement();
+
+            StartStatement();
+            if (!halted_ && DescendNext(node.kids_))
+                return;
+
+            auto block = PopScope();
+            if (blocks_.empty())
+                residual_->root_ = block;
+            else if (!block->kids_.empty())
+                Emit(block);
+        }
+
+        void Visit(node::DeclNode &node) override {}
+
+        void Visit(node::CondNode &node) override {
+            switch (GetStep()) {
+                case 0:
+                    StartStatement();
+                    assert(node.predicat_);
+                    if (!Evaluate(*node.predicat_, 1))
+                        return;
+                    [[fallthrough]];
+                case 1: {
+                    auto predicat = PopValue();
+                    assert(node.first_);
+                    if (predicat.number) {
+                        auto branch = *predicat.number ? node.first_ : node.second_;
+                        if (branch != nullptr) {
+                            StartStatement();
+                            Descend(*branch, 2);
+                        }
+                        return;
+                    }
+
+                    auto effects = GetEffects(*node.first_);
+                    if (node.second_)
+                        effects.Merge(GetEffects(*node.second_));
+                    auto catch_up = Generalize(effects, node.location_);
+                    auto code = PlaceCatchUp(predicat.code, catch_up, node.location_);
+                    auto first = CopyStatement(*node.first_);
+                    auto second = node.second_ ? CopyStatement(*node.second_) : nullptr;
+                    if (first == nullptr)
+                        first = Make<node::ScopeNode>(node.location_);
+                    Emit(Make<node::CondNode>(code, first, second, node.location_));
+                    FinishStatement();
+                    return;
+                }
+                default:
+                    FinishStatement();
+                    return;
+            }
+        }
+
+        // Steps alternate between the predicate and the body, like in the
+        // interpreter
+        void Visit(node::LoopNode &node) override {
+            assert(node.predicat_ && node.scope_);
+            auto step = GetStep();
+            if (step == 0) {
+                if (SkipLoop(node))
+                    return;
+                runs_.push_back({});
+            }
+            if (step == 2) {
+                FinishStatement();
+                if (emitted_ != runs_.back().emitted)
+                    ++runs_.back().unrolled;
+            }
+
+            if (step != 1) {
+                if (halted_) {
+                    runs_.pop_back();
+                    return;
+                }
+                // the rest of the run is left to the residual program
+                if (over_budget_ || runs_.back().unrolled >= max_unroll_) {
+                    LeaveLoop(node);
+                    return;
+                }
+                runs_.back().emitted = emitted_;
+                StartStatement();
+                if (!Evaluate(*node.predicat_, 1))
+                    return;
+            }
+
+            auto predicat = PopValue();
+            if (predicat.number) {
+                if (*predicat.number) {
+                    StartStatement();
+                    Descend(*node.scope_, 2);
+                    return;
+                }
+                runs_.pop_back();
+                return;
+            }
+
+            auto &effects = GetEffects(*node.predicat_);
+            if (effects.assigned.empty() && !effects.reads)
+                LeaveLoop(node);
+            else
+                PeelLoop(node, predicat.code);
+        }
+
+        void Visit(node::AssignNode &node) override {
+            assert(node.expr_ && node.var_);
+            if (GetStep() == 0 && !Evaluate(*node.expr_, 1))
+                return;
+
+            auto value = PopValue();
+            auto name = node.var_->name_;
+            auto binding = Find(name);
+            if (binding == nullptr) {
+                Declare(name, value.number, !value.number, false);
+                if (value.number) {
+                    PushNumber(*value.number);
+                    return;
+                }
+            } else if (value.number && binding->number) {
+                binding->number = value.number;
+                binding->synced = false;
+                PushNumber(*value.number);
+                return;
+            } else if (value.number) {
+                // the residual program holds the variable, it keeps up
+                if (!binding->maybe) {
+                    binding->number = value.number;
+                    binding->synced = true;
+                }
+                value.code = Make<node::NumberNode>(*value.number, node.expr_->location_);
+            } else {
+                LeaveToRun(*binding, name, node.location_);
+            }
+            auto var = Make<node::DeclNode>(name, node.var_->location_);
+            PushCode(Make<node::AssignNode>(var, value.code, node.location_));
+        }
+
+        void Visit(node::OutputNode &node) override {
+            assert(node.expr_);
+            if (GetStep() == 0 && !Evaluate(*node.expr_, 1))
+                return;
+            auto expr = ToCode(PopValue(), *node.expr_);
+            Emit(Make<node::OutputNode>(expr, node.location_));
+        }
+
+    private:
+        static constexpr size_t STEP_CHUNK = 4096;
+
+        // The value of an expression: a number known now, or residual code
+        // that computes it
+        struct Value final {
+            std::optional<int> number;
+            node::ExprNode *code = nullptr;
+        }; // struct Value
+
+        struct Binding final {
+            // nothing once the value is left to the run
+            std::optional<int> number;
+            // index of the scope that declared the variable
+            size_t scope;
+            // the residual program has the variable in the same scope
+            bool declared;
+            // ... and it holds the number
+            bool synced;
+            // the residual program may or may not have declared the
+            // variable, it stays with the run
+            bool maybe;
+        }; // struct Binding
+
+        // Residual code to run before code that may assign variables or read
+        // input: it stores the numbers known for the variables and skips the
+        // numbers read so far
+        struct CatchUp final {
+            std::vector<std::pair<intern::Atom, int>> assignments;
+            size_t skipped = 0;
+
+            bool Empty() const {
+                return assignments.empty() && skipped == 0;
+            }
+        }; // struct CatchUp
+
+        // A run of a loop being unrolled
+        struct Run final {
+            // iterations that left code behind
+            size_t unrolled = 0;
+            // statements emitted before the current iteration
+            size_t emitted = 0;
+        }; // struct Run
+
+        template <typename T, typename... Args>
+        T *Make(Args&&... args) {
+            return residual_->builder_.template GetObj<T>(std::forward<Args>(args)...);
+        }
+
+        bool Evaluate(node::ExprNode &expr, size_t next_step) {
+            if (expr.IsLeaf()) {
+                expr.Accept(*this);
+                return true;
+            }
+            Descend(expr, next_step);
+            return false;
+        }
+
+        template <typename Node>
+        bool EvaluateOperands(Node &node) {
+            switch (GetStep()) {
+                case 0:
+                    assert(node.left_);
+                    if (!Evaluate(*node.left_, 1))
+                        return false;
+                    [[fallthrough]];
+                case 1:
+                    assert(node.right_);
+                    return Evaluate(*node.right_, 2);
+                default:
+                    return true;
+            }
+        }
+
+        Value PopValue() {
+            assert(!values_.empty());
+            auto value = values_.back();
+            values_.pop_back();
+            return value;
+        }
+
+        void PushNumber(int number) {
+            values_.push_back({ number, nullptr });
+        }
+
+        void PushCode(node::ExprNode *code) {
+            values_.push_back({ std::nullopt, code });
+        }
+
+        node::ExprNode *ToCode(const Value &value, const node::Node &node) {
+            if (value.number)
+                return Make<node::NumberNode>(*value.number, node.location_);
+            return value.code;
+        }
+
+        Binding *Find(intern::Atom name) {
+            if (name < bindings_.size() && bindings_[name])
+                return &*bindings_[name];
+            return nullptr;
+        }
+
+        void Declare(intern::Atom name, std::optional<int> number, bool declared, bool maybe) {
+            if (name >= bindings_.size())
+                bindings_.resize(name + 1);
+            assert(!bindings_[name]);
+            bindings_[name] = Binding{ number, scopes_.size() - 1, declared, declared, maybe };
+            scopes_.back().push_back(name);
+        }
+
+        void PushScope(const yy::Location &location) {
+            scopes_.emplace_back();
+            blocks_.push_back(Make<node::ScopeNode>(location));
+        }
+
+        node::ScopeNode *PopScope() {
+            assert(!scopes_.empty());
+            for (auto name : scopes_.back())
+                bindings_[name].reset();
+            scopes_.pop_back();
+            auto block = blocks_.back();
+            blocks_.pop_back();
+            return block;
+        }
+
+        void Emit(node::Node *statement) {
+            blocks_.back()->AddStatement(statement);
+            ++emitted_;
+        }
+
+        void StartStatement() {
+            statement_skipped_ = skipped_;
+        }
+
+        // An assignment used as a statement leaves its value, the residual
+        // program gets the assignment if it is code
+        void FinishStatement() {
+            if (!values_.empty()) {
+                auto value = PopValue();
+                assert(values_.empty());
+                if (value.code != nullptr)
+                    Emit(value.code);
+            }
+            halted_ = halted_ || failed_;
+        }
+
+        // From now on the residual program holds the variable. One declared
+        // here in an outer scope is declared there in the residual program
+        // too, before the scope open in it.
+        void LeaveToRun(Binding &binding, intern::Atom name, const yy::Location &location) {
+            if (!binding.number)
+                return;
+            if (!binding.declared && binding.scope + 1 != scopes_.size()) {
+                blocks_[binding.scope]->AddStatement(Assignment(name, *binding.number, location));
+                ++emitted_;
+                binding.declared = binding.synced = true;
+            }
+            binding.number.reset();
+        }
+
+        // Leaves what the code may assign to the run and returns what the
+        // residual program must do before the code runs
+        CatchUp Generalize(const Effects &effects, const yy::Location &location) {
+            CatchUp catch_up;
+            for (auto name : effects.assigned) {
+                auto binding = Find(name);
+                if (binding == nullptr || !binding->number)
+                    continue;
+                auto number = *binding->number;
+                bool synced = binding->synced;
+                LeaveToRun(*binding, name, location);
+                if (!synced && !binding->synced)
+                    catch_up.assignments.emplace_back(name, number);
+                binding->declared = binding->synced = true;
+            }
+            // the code may declare these here or not, the run decides
+            for (auto name : effects.direct) {
+                if (Find(name) == nullptr)
+                    Declare(name, std::nullopt, true, true);
+            }
+            if (effects.reads && input_known_) {
+                catch_up.skipped = skipped_;
+                skipped_ = statement_skipped_ = 0;
+                input_known_ = false;
+            }
+            return catch_up;
+        }
+
+        void EmitCatchUp(const CatchUp &catch_up, const yy::Location &location) {
+            for (auto &[name, number] : catch_up.assignments)
+                Emit(Assignment(name, number, location));
+            if (catch_up.skipped != 0)
+                Emit(SkipBlock(catch_up.skipped, location));
+        }
+
+        // code + 0 * (x = 1) + 0 * ?: the value of the code, the catch up
+        // right after it
+        node::ExprNode *AppendCatchUp(node::ExprNode *code, const CatchUp &catch_up, const yy::Location &location) {
+            auto append = [this, &code, &location](node::ExprNode *effect) {
+                auto zero = Make<node::NumberNode>(0, location);
+                auto discarded = Make<node::BinOpNode>(node::BinOpNode_t::mul, zero, effect, location);
+                code = Make<node::BinOpNode>(node::BinOpNode_t::add, code, discarded, location);
+            };
+            for (auto &[name, number] : catch_up.assignments)
+                append(Assignment(name, number, location));
+            for (size_t i = 0; i < catch_up.skipped; ++i)
+                append(Make<node::InputNode>(location));
+            return code;
+        }
+
+        // The catch up goes before the statement unless the code already
+        // computed reads what it changes
+        node::ExprNode *PlaceCatchUp(node::ExprNode *code, const CatchUp &catch_up, const yy::Location &location) {
+            if (catch_up.Empty())
+                return code;
+            std::unordered_set<intern::Atom> names;
+            for (auto &assignment : catch_up.assignments)
+                names.insert(assignment.first);
+            if (details::TouchVisitor().Touches(*code, names, catch_up.skipped != 0))
+                return AppendCatchUp(code, catch_up, location);
+            EmitCatchUp(catch_up, location);
+            return code;
+        }
+
+        node::AssignNode *Assignment(intern::Atom name, int number, const yy::Location &location) {
+            return Assignment(name, Make<node::NumberNode>(number, location), location);
+        }
+
+        node::AssignNode *Assignment(intern::Atom name, node::ExprNode *expr, const yy::Location &location) {
+            return Make<node::AssignNode>(Make<node::DeclNode>(name, location), expr, location);
+        }
+
+        // A read of the residual program. Numbers read here before the
+        // statement are skipped by a loop before it, those read in the
+        // statement by the expression itself: 0 * ? + ... + ?.
+        node::ExprNode *Read(const yy::Location &location) {
+            assert(input_known_ || skipped_ == 0);
+            if (statement_skipped_ != 0)
+                Emit(SkipBlock(statement_skipped_, location));
+
+            node::ExprNode *read = Make<node::InputNode>(location);
+            for (auto i = statement_skipped_; i < skipped_; ++i) {
+                auto zero = Make<node::NumberNode>(0, location);
+                auto skip = Make<node::BinOpNode>(node::BinOpNode_t::mul, zero, Make<node::InputNode>(location), location);
+                read = Make<node::BinOpNode>(node::BinOpNode_t::add, skip, read, location);
+            }
+            skipped_ = statement_skipped_ = 0;
+            return read;
+        }
+
+        // { skip = count; while (skip > 0) skip = skip - 1 + 0 * ?; }
+        node::ScopeNode *SkipBlock(size_t count, const yy::Location &location) {
+            if (!skip_name_)
+                skip_name_ = FreshName("skipped");
+            auto name = *skip_name_;
+            auto block = Make<node::ScopeNode>(location);
+            for (; count != 0; count -= std::min<size_t>(count, std::numeric_limits<int>::max())) {
+                auto chunk = int(std::min<size_t>(count, std::numeric_limits<int>::max()));
+                block->AddStatement(Assignment(name, chunk, location));
+                auto zero = Make<node::NumberNode>(0, location);
+                auto predicat = Make<node::BinCompOpNode>(node::BinCompOpNode_t::greater,
+                                                          Make<node::VarNode>(name, location), zero, location);
+                auto one = Make<node::NumberNode>(1, location);
+                auto next = Make<node::BinOpNode>(node::BinOpNode_t::sub, Make<node::VarNode>(name, location), one, location);
+                auto skip = Make<node::BinOpNode>(node::BinOpNode_t::mul, Make<node::NumberNode>(0, location),
+                                                  Make<node::InputNode>(location), location);
+                auto step = Make<node::BinOpNode>(node::BinOpNode_t::add, next, skip, location);
+                block->AddStatement(Make<node::LoopNode>(predicat, Assignment(name, step, location), location));
+            }
+            return block;
+        }
+
+        // A name of the residual program the program does not use
+        intern::Atom FreshName(const std::string &base) {
+            auto &interner = residual_->interner_;
+            for (size_t suffix = 0;; ++suffix) {
+                auto atom = interner.Intern(suffix == 0 ? base : base + "_" + std::to_string(suffix));
+                if (atom >= interner_.GetSize())
+                    return atom;
+            }
+        }
+
+        const Effects &GetEffects(node::Node &node) {
+            auto known = effects_.find(&node);
+            if (known != effects_.end())
+                return known->second;
+            return effects_.emplace(&node, details::EffectsVisitor().Collect(node)).first->second;
+        }
+
+        std::optional<int> Lookup(intern::Atom name) {
+            auto binding = Find(name);
+            return binding != nullptr ? binding->number : std::nullopt;
+        }
+
+        node::Node *CopyStatement(node::Node &node) {
+            details::CopyVisitor copier(residual_->builder_, [this](intern::Atom name) { return Lookup(name); });
+            return copier.CopyStatement(node);
+        }
+
+        node::ExprNode *CopyExpression(node::ExprNode &node) {
+            details::CopyVisitor copier(residual_->builder_, [this](intern::Atom name) { return Lookup(name); });
+            return copier.CopyExpression(node);
+        }
+
+        // Assigns the final values of a loop with a closed form on known
+        // values, false if the loop has to run
+        bool SkipLoop(const node::LoopNode &node) {
+            auto loop = loops_ != nullptr ? loops_->Find(node) : nullptr;
+            if (loop == nullptr || halted_)
+                return false;
+
+            auto lookup = [this](intern::Atom name) -> std::optional<bigint::Integer> {
+                auto number = Lookup(name);
+                if (!number)
+                    return std::nullopt;
+                return executer::Arithmetic<int>::ToExact(*number);
+            };
+            auto narrow = [](const bigint::Integer &value) {
+                return executer::Arithmetic<int>::ToExact(executer::Arithmetic<int>::FromExact(value));
+            };
+            auto results = induction::Solve(*loop, lookup, narrow);
+            if (!results)
+                return false;
+            for (auto &[name, value] : *results) {
+                auto binding = Find(name);
+                assert(binding != nullptr && binding->number);
+                binding->number = executer::Arithmetic<int>::FromExact(value);
+                binding->synced = false;
+            }
+            return true;
+        }
+
+        // The rest of the run goes to the residual program as it is
+        void LeaveLoop(node::LoopNode &node) {
+            runs_.pop_back();
+            auto catch_up = Generalize(GetEffects(node), node.location_);
+            EmitCatchUp(catch_up, node.location_);
+            if (auto copy = CopyStatement(node))
+                Emit(copy);
+            FinishStatement();
+        }
+
+        // The predicate with effects has just run here and its value is
+        // code, the loop is taken over with that value as its first test:
+        //
+        //     test = code; first = 1;
+        //     while ((!first && predicat) || (first && 0 * (first = 0) + test))
+        //         body
+        //
+        // The predicate stays in the scope of the loop and the body is not
+        // wrapped, so both declare what they declare where the program does.
+        void PeelLoop(node::LoopNode &node, node::ExprNode *code) {
+            runs_.pop_back();
+            auto location = node.location_;
+            auto catch_up = Generalize(GetEffects(node), location);
+            code = PlaceCatchUp(code, catch_up, location);
+            if (!test_name_) {
+                test_name_ = FreshName("test");
+                first_name_ = FreshName("first");
+            }
+            auto test = *test_name_, first = *first_name_;
+            Emit(Assignment(test, code, location));
+            Emit(Assignment(first, 1, location));
+
+            auto later = Make<node::LogicOpNode>(node::LogicOpNode_t::logic_and,
+                                                 Make<node::UnOpNode>(node::UnOpNode_t::negation,
+                                                                      Make<node::VarNode>(first, location), location),
+                                                 CopyExpression(*node.predicat_), location);
+            auto zero = Make<node::NumberNode>(0, location);
+            auto reset = Make<node::BinOpNode>(node::BinOpNode_t::mul, zero, Assignment(first, 0, location), location);
+            auto peeled = Make<node::LogicOpNode>(node::LogicOpNode_t::logic_and, Make<node::VarNode>(first, location),
+                                                  Make<node::BinOpNode>(node::BinOpNode_t::add, reset,
+                                                                        Make<node::VarNode>(test, location), location),
+                                                  location);
+            auto predicat = Make<node::LogicOpNode>(node::LogicOpNode_t::logic_or, later, peeled, location);
+            auto body = CopyStatement(*node.scope_);
+            if (body == nullptr)
+                body = Make<node::ScopeNode>(node.scope_->location_);
+            Emit(Make<node::LoopNode>(predicat, body, location));
+            FinishStatement();
+        }
+
+        const intern::Interner &interner_;
+        const KnownInput &known_;
+        const induction::Analysis *loops_;
+        size_t max_steps_;
+        size_t max_unroll_;
+
+        std::unique_ptr<Residual> residual_;
+        std::vector<Value> values_;
+        // a name has one binding at most, see above
+        std::vector<std::optional<Binding>> bindings_;
+        // names each open scope declared and its residual block
+        std::vector<std::vector<intern::Atom>> scopes_;
+        std::vector<node::ScopeNode*> blocks_;
+        std::vector<Run> runs_;
+        std::unordered_map<const node::Node*, Effects> effects_;
+
+        // the next number of the known input, while reads are counted here
+        size_t position_ = 0;
+        bool input_known_ = true;
+        // numbers read here the residual program has not skipped yet, and
+        // how many of them were read before the current statement
+        size_t skipped_ = 0;
+        size_t statement_skipped_ = 0;
+        size_t emitted_ = 0;
+        // an error was left in the residual program, and its statement is done
+        bool failed_ = false;
+        bool halted_ = false;
+        bool over_budget_ = false;
+        std::optional<intern::Atom> skip_name_;
+        std::optional<intern::Atom> test_name_;
+        std::optional<intern::Atom> first_name_;
+    }; // class SpecializeVisitor
+} // namespace specializer
@@ -0,0 +1,95 @@
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "protocol.hpp"
+
+namespace {
+    std::string ReadSource(const char *file_name) {
+        std::ifstream file(file_name);
+        if (!file.is_open())
+            throw std::invalid_argument("Can't open file");
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    int Connect(const char *socket_path) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (std::strlen(socket_path) >= sizeof(address.sun_path))
+            throw std::invalid_argument("Socket path is too long");
+        std::strcpy(address.sun_path, socket_path);
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            ::close(fd);
+            throw std::runtime_error(std::string("connect: ") + std::strerror(errno));
+        }
+        return fd;
+    }
+
+    // Asks for the cached program first and sends the source only when the
+    // daemon does not know it
+    std::vector<std::string> Run(int fd, const std::string &source, const std::string &input) {
+        std::vector<std::string> response;
+        auto hash = protocol::HashSource(source);
+        if (!protocol::WriteMessage(fd, { protocol::RUN_HASH, hash, input }) ||
+            !protocol::ReadMessage(fd, response, 2))
+            throw std::runtime_error("Connection to the daemon is lost");
+
+        if (response[0] == protocol::UNKNOWN) {
+            if (!protocol::WriteMessage(fd, { protocol::RUN, source, input }) ||
+                !protocol::ReadMessage(fd, response, 2))
+                throw std::runtime_error("Connection to the daemon is lost");
+        }
+
+        if (response[0] != protocol::OK)
+            throw std::runtime_error("Unexpected response from the daemon");
+
+        std::vector<std::string> result;
+        if (!protocol::ReadMessage(fd, result, 2))
+            throw std::runtime_error("Connection to the daemon is lost");
+        return result;
+    }
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cout << "Usage: " << argv[0] << " <socket> <file program>" << std::endl;
+        return 1;
+    }
+
+    try {
+        auto source = ReadSource(argv[2]);
+        std::string input(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>{});
+
+        int fd = Connect(argv[1]);
+        std::vector<std::string> result;
+        try {
+            result = Run(fd, source, input);
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+
+        auto &output = result[0];
+        auto &diagnostics = result[1];
+        std::cout << output;
+        if (!diagnostics.empty())
+            std::cout << diagnostics << std::endl;
+    } catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+}
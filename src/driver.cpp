@@ -1,17 +1,238 @@
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <iterator>
+#include <thread>
+
 #include "driver.hpp"
+#include "server.hpp"
+
+namespace {
+    struct Options final {
+        const char *file_name = nullptr;
+        bool use_ir = false;
+        bool big_integers = false;
+        bool dump_ir = false;
+        bool optimize = true;
+        const char *c_file = nullptr;
+        const char *binary = nullptr;
+        const char *dot_file = nullptr;
+        drawer::DrawOptions draw;
+        const char *known_input = nullptr;
+        const char *residual_file = nullptr;
+        const char *socket_path = nullptr;
+        size_t workers = std::max(1u, std::thread::hardware_concurrency());
+        size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        size_t cache_capacity = 64;
+        size_t max_nesting = yy::DEFAULT_MAX_NESTING;
+    }; // struct Options
+
+    template <typename T>
+    bool ParseNumber(std::string_view text, T &number) {
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+        return error == std::errc{} && end == text.data() + text.size();
+    }
+
+    // Accepts "first:last" or a single line
+    bool ParseLineRange(std::string_view text, drawer::DrawOptions &draw) {
+        auto colon = text.find(':');
+        if (colon == std::string_view::npos)
+            return ParseNumber(text, draw.first_line) && ParseNumber(text, draw.last_line);
+        return ParseNumber(text.substr(0, colon), draw.first_line) && ParseNumber(text.substr(colon + 1), draw.last_line);
+    }
+
+    // Accepts a comma separated list of node ids
+    bool ParseIdList(std::string_view text, drawer::DrawOptions &draw) {
+        for (;;) {
+            auto comma = text.find(',');
+            size_t id = 0;
+            if (!ParseNumber(text.substr(0, comma), id))
+                return false;
+            draw.collapsed.insert(id);
+            if (comma == std::string_view::npos)
+                return true;
+            text.remove_prefix(comma + 1);
+        }
+    }
+
+    bool ParseOptions(int argc, char* argv[], Options &options) {
+        for (int i = 1; i < argc; ++i) {
+            if (!std::strcmp(argv[i], "--ir"))
+                options.use_ir = true;
+            else if (!std::strcmp(argv[i], "--bigint"))
+                options.big_integers = true;
+            else if (!std::strcmp(argv[i], "--dump-ir"))
+                options.dump_ir = true;
+            else if (!std::strcmp(argv[i], "-O0"))
+                options.optimize = false;
+            else if (!std::strcmp(argv[i], "--emit-c") && i + 1 < argc)
+                options.c_file = argv[++i];
+            else if (!std::strcmp(argv[i], "--compile") && i + 1 < argc)
+                options.binary = argv[++i];
+            else if (!std::strcmp(argv[i], "--dot") && i + 1 < argc)
+                options.dot_file = argv[++i];
+            else if (!std::strcmp(argv[i], "--known-input") && i + 1 < argc)
+                options.known_input = argv[++i];
+            else if (!std::strcmp(argv[i], "--residual") && i + 1 < argc)
+                options.residual_file = argv[++i];
+            else if (!std::strcmp(argv[i], "--dot-depth") && i + 1 < argc) {
+                if (!ParseNumber(argv[++i], options.draw.max_depth))
+                    return false;
+            } else if (!std::strcmp(argv[i], "--dot-lines") && i + 1 < argc) {
+                if (!ParseLineRange(argv[++i], options.draw))
+                    return false;
+            } else if (!std::strcmp(argv[i], "--dot-collapse") && i + 1 < argc) {
+                if (!ParseIdList(argv[++i], options.draw))
+                    return false;
+            } else if (!std::strcmp(argv[i], "--daemon") && i + 1 < argc)
+                options.socket_path = argv[++i];
+            else if (!std::strcmp(argv[i], "--workers") && i + 1 < argc) {
+                if (!ParseNumber(argv[++i], options.workers) || options.workers == 0)
+                    return false;
+            } else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc) {
+                if (!ParseNumber(argv[++i], options.threads) || options.threads == 0)
+                    return false;
+            } else if (!std::strcmp(argv[i], "--cache") && i + 1 < argc) {
+                if (!ParseNumber(argv[++i], options.cache_capacity) || options.cache_capacity == 0)
+                    return false;
+            } else if (!std::strcmp(argv[i], "--max-nesting") && i + 1 < argc) {
+                if (!ParseNumber(argv[++i], options.max_nesting) || options.max_nesting == 0)
+                    return false;
+            }
+            else if (argv[i][0] == '-' || options.file_name != nullptr)
+                return false;
+            else
+                options.file_name = argv[i];
+        }
+        // only the AST interpreter computes on integers of any size
+        if (options.big_integers && (options.use_ir || options.dump_ir || options.c_file ||
+                                     options.binary || options.socket_path))
+            return false;
+        // the residual program runs on the AST interpreter in 32-bit words
+        if ((options.known_input || options.residual_file) &&
+            (options.use_ir || options.big_integers || options.dump_ir || options.c_file || options.binary ||
+             options.dot_file || options.socket_path))
+            return false;
+        // the daemon receives its programs from clients
+        return (options.file_name != nullptr) != (options.socket_path != nullptr);
+    }
+
+    std::string ReadSource(const char *file_name) {
+        std::ifstream file(file_name);
+        if (!file.is_open())
+            throw std::invalid_argument("Can't open file");
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    specializer::KnownInput ReadKnownInput(const char *file_name) {
+        if (file_name == nullptr)
+            return {};
+        std::ifstream file(file_name);
+        if (!file.is_open())
+            throw std::invalid_argument("Can't open file");
+        return specializer::ParseKnownInput(file);
+    }
+
+    std::string QuoteShellArg(const std::string &arg) {
+        std::string quoted = "'";
+        for (auto c : arg)
+            quoted += (c == '\'' ? std::string("'\\''") : std::string(1, c));
+        return quoted + "'";
+    }
+
+    // Emits binary.c next to the executable and builds it with the system
+    // C compiler, $CC overrides the default cc
+    void CompileNative(const yy::Driver &driver, const std::string &binary) {
+        auto source = binary + ".c";
+        std::ofstream out(source);
+        driver.EmitC(out);
+        out.close();
+        if (!out)
+            throw std::runtime_error("Cannot write '" + source + "'");
+
+        const char *cc = std::getenv("CC");
+        auto command = std::string(cc ? cc : "cc") + " -O2 -o " + QuoteShellArg(binary) + " " + QuoteShellArg(source);
+        if (std::system(command.c_str()) != 0)
+            throw std::runtime_error("C compiler failed: " + command);
+    }
+} // namespace
 
 int main(int argc, char* argv[]) {
+    Options options;
     if (argc < 2) {
         std::cout << "Choose program to execute" << std::endl;
         return 0;
     }
 
+    if (!ParseOptions(argc, argv, options)) {
+        std::cout << "Usage: " << argv[0] << " [--ir | --bigint] [--dump-ir] [-O0] [--emit-c <file.c>] [--compile <binary>]"
+                  << " [--dot <file.dot> [--dot-depth <n>] [--dot-lines <first>:<last>] [--dot-collapse <id,...>]]"
+                  << " [--known-input <file>] [--residual <file.paracl>] [--threads <n>] [--max-nesting <n>] <file program>\n"
+                  << "       " << argv[0] << " --daemon <socket> [--workers <n>] [--cache <n>] [--max-nesting <n>]" << std::endl;
+        return 1;
+    }
+
     try {
-        yy::Driver &driver = yy::Driver::QueryDriver(argv[1]);
+        if (options.socket_path != nullptr) {
+            server::Server server(options.socket_path, options.workers, options.cache_capacity, options.max_nesting);
+            server.Run();
+            return 0;
+        }
+
+        yy::Driver driver(ReadSource(options.file_name), options.max_nesting);
         driver.Parse();
-        driver.DrawAST();
-        driver.Execute();
+        if (options.dump_ir) {
+            driver.DumpIR(std::cout, options.optimize);
+            return 0;
+        }
+
+        if (options.c_file != nullptr) {
+            if (!std::strcmp(options.c_file, "-")) {
+                driver.EmitC(std::cout);
+            } else {
+                std::ofstream out(options.c_file);
+                driver.EmitC(out);
+            }
+            return 0;
+        }
+
+        if (options.binary != nullptr) {
+            CompileNative(driver, options.binary);
+            return 0;
+        }
+
+        if (options.dot_file != nullptr) {
+            if (!std::strcmp(options.dot_file, "-")) {
+                driver.DrawAST(std::cout, options.draw);
+            } else {
+                std::ofstream out(options.dot_file);
+                driver.DrawAST(out, options.draw);
+            }
+            return 0;
+        }
+
+        if (options.known_input != nullptr || options.residual_file != nullptr) {
+            auto residual = driver.Specialize(ReadKnownInput(options.known_input));
+            if (options.residual_file == nullptr) {
+                residual->Execute(driver.GetErrorHandler(), std::cin, std::cout, options.optimize);
+            } else if (!std::strcmp(options.residual_file, "-")) {
+                residual->Print(std::cout);
+            } else {
+                std::ofstream out(options.residual_file);
+                residual->Print(out);
+            }
+            return 0;
+        }
+
+        if (options.use_ir)
+            driver.ExecuteIR(options.optimize, std::cin, std::cout);
+        else
+            driver.Execute(std::cin, std::cout, options.big_integers, options.optimize, options.threads);
     } catch (std::exception &ex) {
         std::cout << ex.what() << std::endl;
     };
-}
\ No newline at end of file
+}
@@ -105,7 +105,7 @@
 ;
 
 %token <int> NUMBER
-%token <std::string> NAME
+%token <intern::Atom> NAME
 
 %nterm <node::ScopeNode*> Scope
 %nterm <node::ScopeNode*> SubScope
@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <charconv>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "session.hpp"
+
+// Bytes held by live allocations of the whole process, every block carries
+// its size in a header
+namespace {
+    std::atomic<size_t> live_bytes{0};
+    constexpr size_t HEADER_SIZE = alignof(std::max_align_t);
+} // namespace
+
+void *operator new(size_t size) {
+    auto block = static_cast<char*>(std::malloc(size + HEADER_SIZE));
+    if (block == nullptr)
+        throw std::bad_alloc();
+    *reinterpret_cast<size_t*>(block) = size;
+    live_bytes += size;
+    return block + HEADER_SIZE;
+}
+
+void operator delete(void *pointer) noexcept {
+    if (pointer == nullptr)
+        return;
+    auto block = static_cast<char*>(pointer) - HEADER_SIZE;
+    live_bytes -= *reinterpret_cast<size_t*>(block);
+    std::free(block);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+    operator delete(pointer);
+}
+
+namespace {
+    // Every session answers a number n with the sum of the squares of
+    // 0 .. n - 1 until it gets zero. Squares keep the loop from being
+    // replaced with its closed form.
+    const std::string Script = R"(
+n = ?;
+while (n != 0) {
+    s = 0;
+    i = 0;
+    while (i < n) {
+        s = s + i * i;
+        i = i + 1;
+    }
+    print s;
+    n = ?;
+}
+)";
+
+    // Never waits for input, it only takes its share of the threads
+    const std::string HogScript = R"(
+x = 0;
+while (1) {
+    x = x + 1;
+}
+)";
+
+    struct Options final {
+        size_t sessions = 10000;
+        size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        size_t rounds = 10;
+        size_t work = 1000;
+        size_t hogs = 0;
+        size_t slice = session::DEFAULT_SLICE;
+    }; // struct Options
+
+    bool ParseNumber(std::string_view text, size_t &number) {
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+        return error == std::errc{} && end == text.data() + text.size();
+    }
+
+    bool ParseOptions(int argc, char* argv[], Options &options) {
+        for (int i = 1; i + 1 < argc; i += 2) {
+            size_t *number = nullptr;
+            if (!std::strcmp(argv[i], "--sessions"))
+                number = &options.sessions;
+            else if (!std::strcmp(argv[i], "--threads"))
+                number = &options.threads;
+            else if (!std::strcmp(argv[i], "--rounds"))
+                number = &options.rounds;
+            else if (!std::strcmp(argv[i], "--work"))
+                number = &options.work;
+            else if (!std::strcmp(argv[i], "--hogs"))
+                number = &options.hogs;
+            else if (!std::strcmp(argv[i], "--slice"))
+                number = &options.slice;
+            if (number == nullptr || !ParseNumber(argv[i + 1], *number))
+                return false;
+        }
+        // zero would end the sessions
+        return argc % 2 == 1 && options.threads != 0 && options.slice != 0 && options.work != 0;
+    }
+
+    std::shared_ptr<const yy::Driver> Compile(const std::string &source) {
+        auto program = std::make_shared<yy::Driver>(source);
+        program->Parse();
+        return program;
+    }
+
+    double SecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cout << "Usage: " << argv[0] << " [--sessions <n>] [--threads <n>] [--rounds <n>] [--work <n>]"
+                  << " [--hogs <n>] [--slice <n>]" << std::endl;
+        return 1;
+    }
+
+    try {
+        auto program = Compile(Script);
+        auto hog = Compile(HogScript);
+        session::Scheduler scheduler(options.threads, options.slice);
+
+        for (size_t i = 0; i < options.hogs; ++i)
+            scheduler.Spawn(hog);
+
+        // every session runs up to its first read and waits there
+        auto before = live_bytes.load();
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::shared_ptr<session::Session>> sessions;
+        sessions.reserve(options.sessions);
+        for (size_t i = 0; i < options.sessions; ++i)
+            sessions.push_back(scheduler.Spawn(program));
+        for (auto &session : sessions)
+            scheduler.Wait(session);
+        auto spawn_time = SecondsSince(start);
+        auto waiting_bytes = live_bytes.load() - before;
+
+        auto request = std::to_string(options.work) + "\n";
+        unsigned sum = 0;
+        for (unsigned i = 0; i < options.work; ++i)
+            sum += i * i;
+        auto expected = std::to_string(int(sum)) + "\n";
+        size_t wrong = 0;
+        double slowest_round = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t round = 0; round < options.rounds; ++round) {
+            auto round_start = std::chrono::steady_clock::now();
+            for (auto &session : sessions)
+                scheduler.Feed(session, request);
+            for (auto &session : sessions) {
+                scheduler.Wait(session);
+                wrong += scheduler.TakeOutput(session) != expected;
+            }
+            slowest_round = std::max(slowest_round, SecondsSince(round_start));
+        }
+        auto run_time = SecondsSince(start);
+        auto busy_bytes = live_bytes.load() - before;
+
+        for (auto &session : sessions) {
+            scheduler.Feed(session, "0\n");
+            wrong += scheduler.Wait(session) != session::State::Finished;
+        }
+
+        auto requests = double(options.sessions * options.rounds);
+        std::cout << "sessions:             " << options.sessions << " on " << options.threads << " threads"
+                  << (options.hogs ? ", " + std::to_string(options.hogs) + " busy looping" : std::string{}) << "\n"
+                  << "spawn and first read: " << spawn_time << " s\n"
+                  << "memory per session:   " << waiting_bytes / std::max<size_t>(options.sessions, 1) << " bytes waiting, "
+                  << busy_bytes / std::max<size_t>(options.sessions, 1) << " bytes after the rounds\n"
+                  << "requests:             " << requests << " in " << run_time << " s, "
+                  << requests / run_time << " per second\n"
+                  << "loop iterations:      " << requests * double(options.work) / run_time << " per second\n"
+                  << "slowest round:        " << slowest_round << " s\n"
+                  << "wrong answers:        " << wrong << std::endl;
+        return wrong == 0 ? 0 : 1;
+    } catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+}
@@ -1,11 +1,72 @@
+import os
 import sys
-from subprocess import run, Popen, PIPE
+import time
+import socket
+import atexit
+import tempfile
+from subprocess import run, Popen, PIPE, DEVNULL, TimeoutExpired
 from sys import executable
 
 generator = sys.argv[1]
+flags = sys.argv[2:]
+
+# --native builds every program with --compile and checks the executable
+native = "--native" in flags
+flags = [flag for flag in flags if flag != "--native"]
+binary = os.path.join(tempfile.mkdtemp(), "program")
+# the generated C has to build without warnings
+if native:
+    os.environ["CC"] = os.environ.get("CC", "cc") + " -Wall -Werror"
+
+# --daemon <client> starts the interpreter as a daemon and runs every program
+# through the client twice, the second run is served from the program cache
+client = None
+if "--daemon" in flags:
+    index = flags.index("--daemon")
+    client = flags[index + 1]
+    flags = flags[:index] + flags[index + 2:]
+    socket_path = os.path.join(tempfile.mkdtemp(), "paracl.sock")
+    daemon = Popen([generator, *flags, "--daemon", socket_path], stdout = DEVNULL)
+    atexit.register(daemon.terminate)
+    for _ in range(100):
+        if os.path.exists(socket_path):
+            break
+        time.sleep(0.05)
+
+# A .in file next to the program is its input, otherwise the input is empty
+def read_input(path):
+    input_path = path[:-len(".paracl")] + ".in"
+    if not os.path.exists(input_path):
+        return ""
+    with open(input_path) as file:
+        return file.read()
+
+def run_program(path, extra = []):
+    data = read_input(path)
+    if client:
+        first = run([client, socket_path, path], input = data, capture_output = True, encoding='cp866').stdout
+        second = run([client, socket_path, path], input = data, capture_output = True, encoding='cp866').stdout
+        if first != second:
+            return first + "\ncached run differs:\n" + second
+        return first
+
+    if not native:
+        return run([generator, *flags, *extra, path], input = data, capture_output = True, encoding='cp866').stdout
+
+    if os.path.exists(binary):
+        os.remove(binary)
+    result = run([generator, *flags, *extra, "--compile", binary, path], capture_output = True, encoding='cp866')
+    if not os.path.exists(binary):
+        return result.stdout
+    return result.stdout + run([binary], input = data, capture_output = True, encoding='cp866').stdout
+
+# Cases are numbered files, every one found in the directory is run
+def case_numbers(directory):
+    return sorted(int(name[:-len(".paracl")]) for name in os.listdir(directory) if name.endswith(".paracl"))
+
 num_test = 1
 is_ok = True
-for i in range(1, 24):
+for i in case_numbers("right"):
     print("Right tests:")
     str_data =  "right/" + str(i) + ".paracl"
     str_ans = "right/" + str(i) + ".ans"
@@ -14,10 +75,10 @@ for i in range(1, 24):
     for i in open(str_ans):
         ans.append(float(i.strip()))
 	
-    result = run([generator, str_data], capture_output = True, encoding='cp866')
+    stdout = run_program(str_data)
     print("Test: " + str(num_test).strip())
 
-    res = list(map(float, result.stdout.split()))
+    res = list(map(float, stdout.split()))
     eps = 0.00001
 
     if len(res) == len(ans):
@@ -44,7 +105,7 @@ print("=========================================================================
 print("==================================================================================================")
 print("==================================================================================================")
 print()
-for i in range(1, 11):
+for i in case_numbers("wrong"):
     print("Wrong tests:")
     str_data =  "wrong/" + str(i) + ".paracl"
     str_ans = "wrong/" + str(i) + ".ans"
@@ -53,10 +114,10 @@ for i in range(1, 11):
     for i in open(str_ans):
         ans.append(i)
 	
-    result = run([generator, str_data], capture_output = True, encoding='cp866')
+    stdout = run_program(str_data)
     print("Test: " + str(num_test).strip())
 
-    res = list(result.stdout.split('\n'))
+    res = list(stdout.split('\n'))
     res1 = []
     for i in range(len(res)):
         if res[i] != '':
@@ -86,6 +147,204 @@ for i in range(1, 11):
     print("-------------------------------------------------")
     num_test += 1
 
+print()
+print("==================================================================================================")
+print()
+# Programs nested far deeper than any call stack allows, generated here to keep
+# the repository small. C compilers give up on deep nesting long before the
+# interpreter does, so native builds get shallower programs.
+depth = 2000 if native else 200000
+nested_ifs = "x = 3;\n" + "if (x > 0) " * depth + "print x;\n"
+deep_tests = [
+    ("x = " + "1 + " * (depth - 1) + "1;\nprint x;\n", str(depth)),
+    ("x = 7;\n" + "{" * depth + "print x;" + "}" * depth + "\n", "7"),
+    (nested_ifs, "3"),
+    ("print " + "-" * depth + "5;\n", "5" if depth % 2 == 0 else "-5"),
+    ("print " + "(" * depth + "9" + ")" * depth + ";\n", "9"),
+    ("x = 0;\n" + "while (x < 1) {" * 100 + "x = x + 1;" + "}" * 100 + "\nprint x;\n", "1"),
+    # the read after the joins places a phi at every one of them
+    ("x = 3;\n" + "{ if (x < 5) " * depth + "x = x + 1;" + " }" * depth + "\nprint x;\n", "4"),
+    # the invariant is hoisted out of every one of the loops in turn
+    ("x = 0;\ny = 2;\n" + "while (x < 1) {" * depth + "x = x + y * 3 - 5;" + "}" * depth + "\nprint x;\n", "1")
+]
+deep_dir = tempfile.mkdtemp()
+for source, ans in deep_tests:
+    print("Deep tests:")
+    path = os.path.join(deep_dir, str(num_test) + ".paracl")
+    with open(path, "w") as file:
+        file.write(source)
+
+    stdout = run_program(path)
+    print("Test: " + str(num_test).strip())
+    if stdout.split() == [ans]:
+        print("OK")
+    else:
+        is_ok = False
+        print("ERROR\nExpect:", ans, "\nGive:  ", stdout[:200])
+    print("-------------------------------------------------")
+    num_test += 1
+
+# The daemon takes its options on start, so the limit is checked directly
+if not client:
+    print("Nesting limit test:")
+    nested_ifs_path = os.path.join(deep_dir, "nested_ifs.paracl")
+    with open(nested_ifs_path, "w") as file:
+        file.write(nested_ifs)
+    stdout = run_program(nested_ifs_path, ["--max-nesting", "100"])
+    print("Test: " + str(num_test).strip())
+    if stdout.startswith("Syntax error: nesting is deeper than 100 levels, at line #2:"):
+        print("OK")
+    else:
+        is_ok = False
+        print("ERROR\nGive:  ", stdout[:200])
+    print("-------------------------------------------------")
+    num_test += 1
+
+# Loops of billions of iterations finish at once when the AST interpreter
+# replaces them with their closed forms. Answers are given for 32-bit words
+# and for --bigint, None where the loop never ends.
+if not client and not native and "--ir" not in flags and "-O0" not in flags:
+    bigint = "--bigint" in flags
+    loop_tests = [
+        ("s = 0;\ni = 0;\nc = 5;\nt = 7;\nwhile (i < 2000000000) {\n    s = s + i;\n    t = t + 2 * i + c;\n    i = i + 1;\n}\n" +
+         "print s;\nprint t;\nprint i;\n",
+         ["321730048", "2053525511", "2000000000"], ["1999999999000000000", "4000000008000000007", "2000000000"]),
+        ("i = 3;\ns = 0;\nn = 7 * 300000000 + 3;\nwhile (n != i) {\n    s = s + i * 3 - 1;\n    i = i + 7;\n}\nprint s;\nprint i;\n",
+         ["336226432", "2100000003"], ["944999999250000000", "2100000003"]),
+        ("i = 100;\nk = 0;\nwhile (i >= -50) {\n    i = i - 3;\n    k = k + i;\n}\nprint i;\nprint k;\n",
+         ["-53", "1122"], ["-53", "1122"]),
+        ("i = 2147483000;\nc = 0;\nwhile (i > 0) {\n    i = i + 100;\n    c = c + 1;\n}\nprint i;\nprint c;\n",
+         ["-2147483596", "7"], None)
+    ]
+    for source, word_ans, bigint_ans in loop_tests:
+        ans = bigint_ans if bigint else word_ans
+        if ans is None:
+            continue
+        print("Loop tests:")
+        path = os.path.join(deep_dir, str(num_test) + ".paracl")
+        with open(path, "w") as file:
+            file.write(source)
+
+        stdout = run_program(path)
+        print("Test: " + str(num_test).strip())
+        if stdout.split() == ans:
+            print("OK")
+        else:
+            is_ok = False
+            print("ERROR\nExpect:", ans, "\nGive:  ", stdout[:200])
+        print("-------------------------------------------------")
+        num_test += 1
+
+# Arbitrary precision arithmetic is checked against Python integers. Only
+# the AST interpreter takes --bigint, other runs skip it.
+if not client and not native and not flags:
+    fact = 1
+    for i in range(1, 301):
+        fact *= i
+    big = 3 ** 200
+    bigint_tests = [
+        ("n = 300;\nf = 1;\nwhile (n > 1) {\n    f = f * n;\n    n = n - 1;\n}\nprint f;\nprint f / (f / 1000 - 1);\n",
+         [fact, fact // (fact // 1000 - 1)]),
+        ("x = 1;\ni = 0;\nwhile (i < 200) {\n    x = x * 3;\n    i = i + 1;\n}\n" +
+         "print x;\nprint -x;\nprint x / 1000000007;\nprint x % 1000000007;\nprint (x + 1) % x;\n",
+         [big, -big, big // 1000000007, big % 1000000007, 1]),
+        ("x = 2147483647 * 2147483647 * -8;\nprint x;\nprint x / 3;\nprint x % 3;\nprint x / x;\n",
+         [-8 * 2147483647 ** 2, -(8 * 2147483647 ** 2 // 3), -(8 * 2147483647 ** 2 % 3), 1]),
+        ("x = 1073741824 * 1073741824 * 4;\nprint x;\nprint x - 1;\nprint -x - x;\nprint x + x > x;\n",
+         [2 ** 62, 2 ** 62 - 1, -2 ** 63, 1])
+    ]
+    for source, ans in bigint_tests:
+        print("Bigint tests:")
+        path = os.path.join(deep_dir, str(num_test) + ".paracl")
+        with open(path, "w") as file:
+            file.write(source)
+
+        stdout = run_program(path, ["--bigint"])
+        print("Test: " + str(num_test).strip())
+        if stdout.split() == [str(value) for value in ans]:
+            print("OK")
+        else:
+            is_ok = False
+            print("ERROR\nExpect:", ans, "\nGive:  ", stdout[:200])
+        print("-------------------------------------------------")
+        num_test += 1
+
+# Every right case with input is specialized on the first half of its input
+# numbers, the second of them left unknown. The residual program has to give
+# the same answer on the whole input, both run at once and written out as
+# source and run again.
+if not client and not native and not flags:
+    for i in case_numbers("right"):
+        path = "right/" + str(i) + ".paracl"
+        words = read_input(path).split()
+        if not words:
+            continue
+        known = words[:len(words) // 2]
+        if len(known) > 1:
+            known[1] = "?"
+        known_path = os.path.join(deep_dir, str(i) + ".known")
+        with open(known_path, "w") as file:
+            file.write(" ".join(known))
+        with open("right/" + str(i) + ".ans") as file:
+            ans = file.read().split()
+
+        print("Specialization tests:")
+        print("Test: " + str(num_test).strip())
+        stdout = run_program(path, ["--known-input", known_path])
+        residual_path = os.path.join(deep_dir, "residual" + str(i) + ".paracl")
+        with open(residual_path, "w") as file:
+            file.write(run([generator, "--known-input", known_path, "--residual", "-", path],
+                           capture_output = True, encoding='cp866').stdout)
+        residual_stdout = run([generator, residual_path], input = read_input(path),
+                              capture_output = True, encoding='cp866').stdout
+        if stdout.split() == ans and residual_stdout.split() == ans:
+            print("OK")
+        else:
+            is_ok = False
+            print("ERROR\nExpect:", ans, "\nGive:  ", stdout[:200], "\nResidual:", residual_stdout[:200])
+        print("-------------------------------------------------")
+        num_test += 1
+
+# A client that keeps its connection open without sending anything, or
+# stops in the middle of a request, must not hold the only worker of a daemon
+if client:
+    idle_socket_path = os.path.join(tempfile.mkdtemp(), "paracl.sock")
+    idle_daemon = Popen([generator, *flags, "--workers", "1", "--daemon", idle_socket_path], stdout = DEVNULL)
+    atexit.register(idle_daemon.terminate)
+    for _ in range(100):
+        if os.path.exists(idle_socket_path):
+            break
+        time.sleep(0.05)
+    with open(os.path.join(deep_dir, "idle.paracl"), "w") as file:
+        file.write("print 42;\n")
+
+    stalls = [
+        ("nothing", b""),
+        ("a truncated frame header", b"\x00"),
+        ("a truncated frame", b"\x00\x00\x00\x03run\x04\x00\x00\x00print"),
+    ]
+    for name, sent in stalls:
+        print("Idle connection test, the client sends " + name + ":")
+        print("Test: " + str(num_test).strip())
+        idle = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        idle.connect(idle_socket_path)
+        idle.sendall(sent)
+        stdout = ""
+        for _ in range(2):
+            try:
+                stdout += run([client, idle_socket_path, os.path.join(deep_dir, "idle.paracl")], input = "",
+                              capture_output = True, encoding='cp866', timeout = 10).stdout
+            except TimeoutExpired:
+                stdout += "timed out\n"
+        idle.close()
+        if stdout.split() == ["42", "42"]:
+            print("OK")
+        else:
+            is_ok = False
+            print("ERROR\nExpect: 42 42\nGive:  ", stdout[:200])
+        print("-------------------------------------------------")
+        num_test += 1
+
 if is_ok:
     print("TESTS PASSED")
 else:
@@ -0,0 +1,340 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "driver.hpp"
+
+// Runs every .paracl case of the given directories through the driver in
+// this process and compares the output, diagnostics included, with the
+// .ans file next to it byte for byte. A .in file next to the case is its
+// input, otherwise the input is empty. Cases run in parallel; the time of a
+// case is the thread CPU time of its fastest run, so parallel runs do not
+// slow each other down on paper.
+//
+// With a baseline every case must stay within threshold times its recorded
+// time plus a small slack, and a case the baseline has no time for fails.
+// Times are scaled by a fixed calibration workload measured on both
+// machines, so a baseline taken on one machine holds on another of a
+// different speed. A mode the baseline has no calibration for, such as
+// that of an unoptimized build, only checks the output.
+//
+// With --specialize a case is first specialized on the first half of its
+// input numbers, then the residual program runs on the whole input. With
+// --threads the AST interpreter runs independent statements of a case on
+// that many threads.
+namespace {
+    namespace fs = std::filesystem;
+
+    constexpr double SLACK_SECONDS = 0.002;
+
+    struct Options final {
+        bool use_ir = false;
+        bool big_integers = false;
+        bool specialize = false;
+        bool optimize = true;
+        size_t threads = 1;
+        size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+        size_t repeat = 3;
+        double threshold = 1.5;
+        const char *baseline = nullptr;
+        bool update_baseline = false;
+        std::vector<std::string> dirs;
+    }; // struct Options
+
+    struct Case final {
+        std::string name;
+        std::string source;
+        std::string input;
+        std::string expected;
+        std::string output;
+        double seconds = 0;
+    }; // struct Case
+
+    // Times of a mode's cases and of the calibration workload
+    struct Baseline final {
+        double calibration = 0;
+        std::map<std::string, double> seconds;
+    }; // struct Baseline
+
+    template <typename T>
+    bool ParseNumber(std::string_view text, T &number) {
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+        return error == std::errc{} && end == text.data() + text.size();
+    }
+
+    bool ParseOptions(int argc, char* argv[], Options &options) {
+        for (int i = 1; i < argc; ++i) {
+            std::string_view option = argv[i];
+            if (option == "--jobs" || option == "--threads" || option == "--repeat" || option == "--threshold" ||
+                option == "--baseline") {
+                if (++i == argc)
+                    return false;
+            }
+
+            bool valid = true;
+            if (option == "--ir")
+                options.use_ir = true;
+            else if (option == "--bigint")
+                options.big_integers = true;
+            else if (option == "--specialize")
+                options.specialize = true;
+            else if (option == "-O0")
+                options.optimize = false;
+            else if (option == "--update-baseline")
+                options.update_baseline = true;
+            else if (option == "--jobs")
+                valid = ParseNumber(argv[i], options.jobs) && options.jobs != 0;
+            else if (option == "--threads")
+                valid = ParseNumber(argv[i], options.threads) && options.threads != 0;
+            else if (option == "--repeat")
+                valid = ParseNumber(argv[i], options.repeat) && options.repeat != 0;
+            else if (option == "--threshold")
+                valid = ParseNumber(argv[i], options.threshold) && options.threshold >= 1;
+            else if (option == "--baseline")
+                options.baseline = argv[i];
+            else if (option[0] != '-')
+                options.dirs.push_back(argv[i]);
+            else
+                valid = false;
+            if (!valid)
+                return false;
+        }
+        return !options.dirs.empty() && options.use_ir + options.big_integers + options.specialize <= 1 &&
+               (!options.update_baseline || options.baseline != nullptr);
+    }
+
+    // The mode a baseline entry belongs to, spelled like the options. An
+    // unoptimized build of the harness is slower in its own way, so it needs
+    // a baseline of its own.
+    std::string GetMode(const Options &options) {
+        std::string mode = options.use_ir ? "ir" : options.big_integers ? "bigint" :
+                           options.specialize ? "specialize" : "ast";
+        if (!options.optimize)
+            mode += "-O0";
+        if (options.threads > 1)
+            mode += "-threads";
+#ifndef __OPTIMIZE__
+        mode += "-unoptimized";
+#endif
+        return mode;
+    }
+
+    std::string ReadFile(const fs::path &path) {
+        std::ifstream file(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    std::vector<Case> CollectCases(const Options &options) {
+        std::vector<Case> cases;
+        for (auto &dir : options.dirs) {
+            std::vector<fs::path> paths;
+            for (auto &entry : fs::directory_iterator(dir)) {
+                if (entry.path().extension() == ".paracl")
+                    paths.push_back(entry.path());
+            }
+            std::sort(paths.begin(), paths.end());
+
+            for (auto &path : paths) {
+                Case test;
+                test.name = path.generic_string();
+                test.source = ReadFile(path);
+                test.expected = ReadFile(fs::path(path).replace_extension(".ans"));
+                if (auto input = fs::path(path).replace_extension(".in"); fs::exists(input))
+                    test.input = ReadFile(input);
+                cases.push_back(std::move(test));
+            }
+        }
+        return cases;
+    }
+
+    double ThreadSeconds() {
+        timespec time{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+        return double(time.tv_sec) + double(time.tv_nsec) * 1e-9;
+    }
+
+    specializer::KnownInput GetKnownInput(const std::string &input) {
+        std::istringstream numbers(input);
+        std::vector<std::string> words(std::istream_iterator<std::string>(numbers), {});
+        std::ostringstream known;
+        for (size_t i = 0; i < words.size() / 2; ++i)
+            known << words[i] << " ";
+        std::istringstream in(known.str());
+        return specializer::ParseKnownInput(in);
+    }
+
+    // Does what the interpreter does with a file, diagnostics go to the output
+    std::string RunProgram(const Case &test, const Options &options) {
+        std::istringstream in(test.input);
+        std::ostringstream out;
+        try {
+            yy::Driver driver(test.source);
+            driver.Parse();
+            if (options.specialize)
+                driver.Specialize(GetKnownInput(test.input))->Execute(driver.GetErrorHandler(), in, out, options.optimize);
+            else if (options.use_ir)
+                driver.ExecuteIR(options.optimize, in, out);
+            else
+                driver.Execute(in, out, options.big_integers, options.optimize, options.threads);
+        } catch (std::exception &ex) {
+            out << ex.what() << std::endl;
+        }
+        return out.str();
+    }
+
+    void RunCase(Case &test, const Options &options) {
+        for (size_t i = 0; i < options.repeat; ++i) {
+            auto start = ThreadSeconds();
+            auto output = RunProgram(test, options);
+            auto seconds = ThreadSeconds() - start;
+            if (i == 0 || seconds < test.seconds)
+                test.seconds = seconds;
+            if (i == 0)
+                test.output = std::move(output);
+        }
+    }
+
+    void RunCases(std::vector<Case> &cases, const Options &options) {
+        std::atomic<size_t> next{0};
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < std::min(options.jobs, cases.size()); ++i) {
+            threads.emplace_back([&] {
+                for (auto index = next++; index < cases.size(); index = next++)
+                    RunCase(cases[index], options);
+            });
+        }
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    // A fixed amount of work that does not depend on the interpreter
+    double Calibrate() {
+        double best = 0;
+        for (size_t run = 0; run < 3; ++run) {
+            auto start = ThreadSeconds();
+            volatile uint64_t state = 1;
+            for (size_t i = 0; i < 20000000; ++i)
+                state = state * 6364136223846793005ull + 1442695040888963407ull;
+            auto seconds = ThreadSeconds() - start;
+            best = run == 0 ? seconds : std::min(best, seconds);
+        }
+        return best;
+    }
+
+    // Lines are "calibration <mode> <seconds>" and "<mode> <case> <seconds>",
+    // every mode keeps its own calibration
+    std::map<std::string, Baseline> ReadBaselines(const char *path) {
+        std::map<std::string, Baseline> baselines;
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream fields(line);
+            std::string mode, name;
+            double seconds = 0;
+            if (line.empty() || line[0] == '#' || !(fields >> mode >> name >> seconds))
+                continue;
+            if (mode == "calibration")
+                baselines[name].calibration = seconds;
+            else
+                baselines[mode].seconds[name] = seconds;
+        }
+        return baselines;
+    }
+
+    void WriteBaselines(const char *path, const std::map<std::string, Baseline> &baselines) {
+        std::ofstream file(path);
+        file << "# Thread CPU seconds per case, written by ParaCLTests --update-baseline\n";
+        file << std::setprecision(6);
+        for (auto &[mode, baseline] : baselines) {
+            file << "calibration " << mode << " " << baseline.calibration << "\n";
+            for (auto &[name, seconds] : baseline.seconds)
+                file << mode << " " << name << " " << seconds << "\n";
+        }
+    }
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cout << "Usage: " << argv[0] << " [--ir | --bigint | --specialize] [-O0] [--threads <n>] [--jobs <n>] [--repeat <n>]"
+                  << " [--baseline <file> [--threshold <ratio>] [--update-baseline]] <dir>..." << std::endl;
+        return 1;
+    }
+
+    try {
+        auto cases = CollectCases(options);
+        auto calibration = options.baseline ? Calibrate() : 0;
+        RunCases(cases, options);
+
+        auto mode = GetMode(options);
+        std::map<std::string, Baseline> baselines;
+        if (options.baseline)
+            baselines = ReadBaselines(options.baseline);
+        auto &baseline = baselines[mode];
+        auto scale = baseline.calibration > 0 ? calibration / baseline.calibration : 1;
+        bool timed = options.baseline && !options.update_baseline && baseline.calibration > 0;
+
+        size_t failed = 0, slow = 0, missing = 0;
+        for (auto &test : cases) {
+            std::string verdict = "OK";
+            double limit = 0;
+            if (test.output != test.expected) {
+                verdict = "FAIL";
+                ++failed;
+            } else if (timed) {
+                auto recorded = baseline.seconds.find(test.name);
+                if (recorded == baseline.seconds.end()) {
+                    verdict = "NEW";
+                    ++missing;
+                } else {
+                    limit = recorded->second * scale * options.threshold + SLACK_SECONDS;
+                    if (test.seconds > limit) {
+                        verdict = "SLOW";
+                        ++slow;
+                    }
+                }
+            }
+
+            std::cout << std::left << std::setw(5) << verdict << std::setw(32) << test.name
+                      << std::fixed << std::setprecision(3) << test.seconds * 1000 << " ms";
+            if (verdict == "SLOW")
+                std::cout << ", limit " << limit * 1000 << " ms";
+            else if (verdict == "NEW")
+                std::cout << ", not in the baseline, run with --update-baseline";
+            std::cout << "\n";
+            if (verdict == "FAIL")
+                std::cout << "--- expected\n" << test.expected << "--- got\n" << test.output << "---\n";
+        }
+
+        if (options.update_baseline) {
+            baseline.calibration = calibration;
+            for (auto &test : cases)
+                baseline.seconds[test.name] = test.seconds;
+            WriteBaselines(options.baseline, baselines);
+        }
+
+        std::cout << cases.size() << " cases in " << mode << " mode, " << failed << " failed, "
+                  << slow << " slower than the baseline";
+        if (missing != 0)
+            std::cout << ", " << missing << " not in the baseline";
+        if (options.baseline && !options.update_baseline && !timed)
+            std::cout << ", times not checked: no baseline for the mode";
+        std::cout << std::endl;
+        return failed == 0 && slow == 0 && missing == 0 && !cases.empty() ? 0 : 1;
+    } catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+}